@@ -38,11 +38,12 @@
 #if defined HAVE_CONFIG_H
 # include "config.h"
 #endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdbool.h>
 #include <math.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/mman.h>
 
 #include "iso4217.h"
 #include "nifty.h"
@@ -57,6 +58,9 @@
 # define CCY_DEBUG_RECOMP(args...)
 #endif	/* DEBUG_FLAG */
 
+/* bid and ask in one go */
+typedef double v2df __attribute__((vector_size(16)));
+
 struct gpair_s {
 	/* 16b */
 	struct pair_s p;
@@ -76,46 +80,147 @@ struct gpair_s {
 		double pri;
 		double qty;
 	} a;
+
+	/* 8b */
+	/* row in the bitset matrices, 0 (all clear) if none */
+	size_t row;
+
+	/* 24b */
+	/* path defs only, the cross they quote and their slots in
+	 * the cross's bid and ask heaps */
+	gcross_t cx;
+	size_t hix[2U];
 };
 
-struct gedge_s {
-	uint64_t x;
+/* heap entries, with the sort key copied over to keep sifting local */
+struct ghent_s {
+	double k;
+	double q;
+	gpath_def_t p;
+};
+
+/* all path defs quoting the same pair, best first */
+struct gcross_s {
+	struct pair_s p;
+	size_t n;
+	size_t alloc;
+	/* H[0] orders by bid, H[1] by ask */
+	struct ghent_s *h[2U];
 };
 
 struct gnode_s {
 	gpair_t x;
+	/* 1 if the hop goes from trm to bas */
+	size_t inv;
 };
 
-union graph_u {
-	struct {
-		size_t npairs;
-		size_t nphops;
-		
-		size_t alloc_pairs;
-		size_t alloc_sz;
-
-		/* edges, they're just bitsets really */
-		struct gedge_s *e;
-		/* path hops */
-		struct gnode_s *f;
-		/* affected path defs edges, just bitsets again */
-		struct gedge_s *aff;
-
-		/* got 8 more bytes now */
-	};
-
-	/* gpairs first */
-	struct gpair_s p[0];
+struct graph_s {
+	size_t npairs;
+	size_t nphops;
+
+	size_t alloc_pairs;
+	size_t alloc_phops;
+	/* words per bitset, enough for ALLOC_PAIRS + 1 bits */
+	size_t nw;
+	/* bitset rows, only pairs that have edges or affect paths get one */
+	size_t nrows;
+	size_t alloc_rows;
+
+	/* pairs and path defs (virtual pairs), index 0 is unused */
+	struct gpair_s *p;
+	/* edges, one bitset of NW words per row */
+	uint64_t *e;
+	/* path hops */
+	struct gnode_s *f;
+	/* affected path defs edges, one bitset of NW words per row */
+	uint64_t *aff;
+	/* what hops along a pair multiply in, Q(g, x)[0] is {bid, ask}
+	 * for going from bas to trm, Q(g, x)[1] is {1/ask, 1/bid} for
+	 * the other way around, kept apart from the pairs to be dense */
+	v2df *q;
+	/* the reciprocals of Q, U(g, x)[0] is {1/bid, 1/ask} and
+	 * U(g, x)[1] is {ask, bid}, so rates can be undone without dividing */
+	v2df *u;
+	/* sizes to go with Q, S(g, x)[0] is {bid qty, ask qty} in bas,
+	 * S(g, x)[1] is {ask qty * ask, bid qty * bid} in trm */
+	v2df *s;
+
+	/* crosses, index 0 is unused */
+	size_t ncross;
+	size_t alloc_cross;
+	struct gcross_s *x;
+
+	/* affected path defs compiled into one list per pair, those of
+	 * pair X are ALST[AOFF[X]] up to ALST[AOFF[X + 1U]], rebuilt from
+	 * the AFF bitsets whenever ADIRTY */
+	size_t *aoff;
+	gpath_def_t *alst;
+	bool adirty;
 };
 
 #define P(g, x)		(g->p[x])
-#define E(g, x)		(g->e[x])
+#define E(g, x)		(g->e + P(g, x).row * g->nw)
 #define F(g, x)		(g->f[x])
-#define AFF(g, x)	(g->aff[x])
+#define AFF(g, x)	(g->aff + P(g, x).row * g->nw)
+#define Q(g, x)		(g->q + 2U * (x))
+#define U(g, x)		(g->u + 2U * (x))
+#define S(g, x)		(g->s + 2U * (x))
+#define X(g, c)		(g->x[c])
+
+#define BSW		(64U)
+
+static inline bool
+bs_tst(const uint64_t *bs, size_t i)
+{
+	return (bs[i / BSW] >> (i % BSW)) & 1U;
+}
+
+static inline void
+bs_set(uint64_t *bs, size_t i)
+{
+	bs[i / BSW] |= 1ULL << (i % BSW);
+	return;
+}
+
+static size_t
+bs_next(const uint64_t *bs, size_t nw, size_t i)
+{
+/* return the first set bit in BS at or after I, or 0 if there's none */
+	size_t w = i / BSW;
+	uint64_t x;
+
+	if (w >= nw) {
+		return 0U;
+	}
+	/* mask out everything before I in the first word */
+	for (x = bs[w] & (~0ULL << (i % BSW)); !x; x = bs[w]) {
+		if (++w >= nw) {
+			return 0U;
+		}
+	}
+	return w * BSW + __builtin_ctzll(x);
+}
+
+static size_t
+bs_popcnt(const uint64_t *bs, size_t nw)
+{
+	size_t res = 0U;
+
+	for (size_t w = 0; w < nw; w++) {
+		res += __builtin_popcountll(bs[w]);
+	}
+	return res;
+}
 
 void
 upd_bid(graph_t g, gpair_t p, double pri, double qty)
 {
+	Q(g, p)[0][0] = pri;
+	Q(g, p)[1][1] = pri != 0.0 ? 1.0 / pri : 0.0;
+	U(g, p)[0][0] = Q(g, p)[1][1];
+	U(g, p)[1][1] = pri;
+	S(g, p)[0][0] = qty;
+	S(g, p)[1][1] = qty * pri;
 	P(g, p).b.pri = pri;
 	P(g, p).b.qty = qty;
 	return;
@@ -124,6 +229,12 @@ upd_bid(graph_t g, gpair_t p, double pri, double qty)
 void
 upd_ask(graph_t g, gpair_t p, double pri, double qty)
 {
+	Q(g, p)[0][1] = pri;
+	Q(g, p)[1][0] = pri != 0.0 ? 1.0 / pri : 0.0;
+	U(g, p)[0][1] = Q(g, p)[1][0];
+	U(g, p)[1][0] = pri;
+	S(g, p)[0][1] = qty;
+	S(g, p)[1][0] = qty * pri;
 	P(g, p).a.pri = pri;
 	P(g, p).a.qty = qty;
 	return;
@@ -150,10 +261,8 @@ prnt_graph(graph_t g)
 			  P(g, i).p.bas->sym, P(g, i).p.trm->sym,
 			  P(g, i).off, P(g, i).len);
 		CCY_DEBUG("  updates affect:\n");
-		for (uint64_t aff = AFF(g, i).x, j = 1; aff; aff >>= 1, j++) {
-			if (!(aff & 1)) {
-				continue;
-			}
+		for (gpair_t j = bs_next(AFF(g, i), g->nw, 1U);
+		     j != NULL_PAIR; j = bs_next(AFF(g, i), g->nw, j + 1U)) {
 			CCY_DEBUG("  + %s%s (%zu)\n",
 				  P(g, j).p.bas->sym, P(g, j).p.trm->sym, j);
 		}
@@ -162,66 +271,152 @@ prnt_graph(graph_t g)
 }
 
 
-static size_t pgsz = 0;
-
 #define INITIAL_PAIRS	(64)
 #define INITIAL_PATHS	(512)
 
-graph_t
-make_graph(void)
+static int
+grow_pairs(graph_t g)
 {
-	graph_t res;
-	size_t tmp = sizeof(*res);
+/* double the number of pairs the graph can hold, bitsets are widened
+ * accordingly so that all rows stay NW words apart */
+	size_t np = g->alloc_pairs ? 2U * g->alloc_pairs : INITIAL_PAIRS;
+	size_t op = g->p != NULL ? g->alloc_pairs + 1U : 0U;
+	size_t nw = (np + 1U + BSW - 1U) / BSW;
+	struct gpair_s *p;
+	uint64_t *e;
+	uint64_t *aff;
+	v2df *q;
+	v2df *u;
+	v2df *s;
+
+	if ((p = realloc(g->p, (np + 1U) * sizeof(*p))) == NULL) {
+		return -1;
+	}
+	memset(p + op, 0, (np + 1U - op) * sizeof(*p));
+	g->p = p;
 
-	if (pgsz == 0) {
-		pgsz = sysconf(_SC_PAGESIZE);
+	if ((q = realloc(g->q, 2U * (np + 1U) * sizeof(*q))) == NULL) {
+		return -1;
 	}
+	memset(q + 2U * op, 0, 2U * (np + 1U - op) * sizeof(*q));
+	g->q = q;
 
-	/* leave room for 63 gpairs, 64 gedges and 512 gpaths */
-	tmp += (INITIAL_PAIRS - 1) * sizeof(*res->p);
-	tmp += INITIAL_PAIRS * sizeof(*res->e);
-	tmp += (INITIAL_PATHS - 2 * INITIAL_PAIRS) * sizeof(*res->f);
-	tmp += INITIAL_PAIRS * sizeof(*res->aff);
-	/* round up to pgsz */
-	if (tmp % pgsz) {
-		tmp -= tmp % pgsz;
-		tmp += pgsz;
+	if ((u = realloc(g->u, 2U * (np + 1U) * sizeof(*u))) == NULL) {
+		return -1;
 	}
+	memset(u + 2U * op, 0, 2U * (np + 1U - op) * sizeof(*u));
+	g->u = u;
 
-	CCY_DEBUG("make graph of size %zu\n", tmp);
-	res = mmap(NULL, tmp, PROT_MEM, MAP_MEM, -1, 0);
+	if ((s = realloc(g->s, 2U * (np + 1U) * sizeof(*s))) == NULL) {
+		return -1;
+	}
+	memset(s + 2U * op, 0, 2U * (np + 1U - op) * sizeof(*s));
+	g->s = s;
+
+	if ((e = calloc(g->alloc_rows * nw, sizeof(*e))) == NULL) {
+		return -1;
+	} else if ((aff = calloc(g->alloc_rows * nw, sizeof(*aff))) == NULL) {
+		free(e);
+		return -1;
+	}
+	for (size_t i = 0; i < g->nrows && g->nw; i++) {
+		memcpy(e + i * nw, g->e + i * g->nw, g->nw * sizeof(*e));
+		memcpy(aff + i * nw, g->aff + i * g->nw, g->nw * sizeof(*aff));
+	}
+	free(g->e);
+	free(g->aff);
+	g->e = e;
+	g->aff = aff;
+	g->nw = nw;
+	g->alloc_pairs = np;
+	return 0;
+}
 
-	/* polish the result, res->p is the only pointer in shape */
-	res->e = (void*)(res->p + INITIAL_PAIRS);
-	res->aff = (void*)(res->e + INITIAL_PAIRS);
-	res->f = (void*)(res->aff + INITIAL_PAIRS);
+static int
+make_row(graph_t g, gpair_t x)
+{
+/* make sure X has its own bitset rows */
+	if (P(g, x).row > 0U) {
+		return 0;
+	} else if (UNLIKELY(g->nrows >= g->alloc_rows)) {
+		size_t nr = 2U * g->alloc_rows;
+		size_t nb = nr * g->nw * sizeof(*g->e);
+		size_t ob = g->alloc_rows * g->nw * sizeof(*g->e);
+		uint64_t *tmp;
+
+		if ((tmp = realloc(g->e, nb)) == NULL) {
+			return -1;
+		}
+		memset((char*)tmp + ob, 0, nb - ob);
+		g->e = tmp;
+		if ((tmp = realloc(g->aff, nb)) == NULL) {
+			return -1;
+		}
+		memset((char*)tmp + ob, 0, nb - ob);
+		g->aff = tmp;
+		g->alloc_rows = nr;
+	}
+	P(g, x).row = g->nrows++;
+	return 0;
+}
+
+graph_t
+make_graph(void)
+{
+	graph_t res;
 
-	res->alloc_sz = tmp;
-	res->alloc_pairs = INITIAL_PAIRS - 1;
-	E(res, 0).x = INITIAL_PAIRS;
-	F(res, 0).x = INITIAL_PATHS - 2 * INITIAL_PAIRS;
-	AFF(res, 0).x = INITIAL_PAIRS;
+	if ((res = calloc(1, sizeof(*res))) == NULL) {
+		return NULL;
+	}
+	/* row 0 stays clear, for pairs without rows of their own */
+	res->nrows = 1U;
+	res->alloc_rows = INITIAL_PAIRS;
+	if (grow_pairs(res) < 0) {
+		goto nope;
+	} else if ((res->f = malloc(INITIAL_PATHS * sizeof(*res->f))) == NULL) {
+		goto nope;
+	}
+	res->alloc_phops = INITIAL_PATHS;
+	CCY_DEBUG("make graph for %zu pairs, %zu path hops\n",
+		  res->alloc_pairs, res->alloc_phops);
 	return res;
+nope:
+	free_graph(res);
+	return NULL;
 }
 
 void
 free_graph(graph_t g)
 {
-	size_t sz = g->alloc_sz;
-
-	munmap(g, sz);
+	free(g->p);
+	free(g->e);
+	free(g->f);
+	free(g->aff);
+	free(g->q);
+	free(g->u);
+	free(g->s);
+	for (gcross_t i = 1; i <= g->ncross; i++) {
+		free(X(g, i).h[0U]);
+		free(X(g, i).h[1U]);
+	}
+	free(g->x);
+	free(g->aoff);
+	free(g->alst);
+	free(g);
 	return;
 }
 
 static gpair_t
 make_gpair(graph_t g)
 {
-	gpair_t r = ++g->npairs;
+	gpair_t r = g->npairs + 1U;
 
-	if (UNLIKELY(r >= g->alloc_pairs)) {
+	if (UNLIKELY(r > g->alloc_pairs) && grow_pairs(g) < 0) {
 		return NULL_PAIR;
 	}
-	return r;
+	/* affected lists need another slot */
+	g->adirty = true;
+	return g->npairs = r;
 }
 
 static __attribute__((unused)) void
@@ -247,12 +442,19 @@ free_gpath_def(graph_t g, gpath_def_t o)
 static gpath_hop_t
 make_gpath_hop(graph_t g)
 {
-	gpath_hop_t r = ++g->nphops;
+	gpath_hop_t r = g->nphops + 1U;
+
+	if (UNLIKELY(r >= g->alloc_phops)) {
+		size_t nf = 2U * g->alloc_phops;
+		struct gnode_s *f;
 
-	if (UNLIKELY(r >= F(g, 0).x)) {
-		return NULL_PATH_HOP;
+		if ((f = realloc(g->f, nf * sizeof(*f))) == NULL) {
+			return NULL_PATH_HOP;
+		}
+		g->f = f;
+		g->alloc_phops = nf;
 	}
-	return r;
+	return g->nphops = r;
 }
 
 static __attribute__((unused)) void
@@ -290,7 +492,7 @@ ccyg_add_pair(graph_t g, struct pair_s p)
 static gedge_t
 find_edge(graph_t g, gpair_t from, gpair_t to)
 {
-	if (E(g, from).x & (1 << (to - 1))) {
+	if (bs_tst(E(g, from), to)) {
 		return from;
 	}
 	return NULL_EDGE;
@@ -302,12 +504,12 @@ add_edge(graph_t g, gpair_t from, gpair_t to)
 	gedge_t tmp;
 
 	if ((tmp = find_edge(g, from, to)) == NULL_EDGE &&
-	    (tmp = (gedge_t)from) != NULL_EDGE) {
+	    (tmp = (gedge_t)from) != NULL_EDGE && make_row(g, tmp) == 0) {
 		/* create a new edge */
 		CCY_DEBUG("ctor'ing %s%s (%zu) -> %s%s (%zu)\n",
 			  P(g, from).p.bas->sym, P(g, from).p.trm->sym, from,
 			  P(g, to).p.bas->sym, P(g, to).p.trm->sym, to);
-		E(g, tmp).x |= 1 << (to - 1);
+		bs_set(E(g, tmp), to);
 	}
 	return;
 }
@@ -324,7 +526,7 @@ find_path_hop(graph_t g, gpath_def_t p, gpair_t x)
 }
 
 static void
-add_path_hop(graph_t g, gpath_def_t tgtpath, gpair_t via)
+add_path_hop(graph_t g, gpath_def_t tgtpath, gpair_t via, bool inv)
 {
 	gpath_hop_t tmp;
 
@@ -335,6 +537,7 @@ add_path_hop(graph_t g, gpath_def_t tgtpath, gpair_t via)
 			  tgtpath,
 			  P(g, via).p.bas->sym, P(g, via).p.trm->sym, via);
 		F(g, tmp).x = via;
+		F(g, tmp).inv = inv;
 		if (P(g, tgtpath).len++ == 0) {
 			P(g, tgtpath).off = tmp;
 		}
@@ -346,7 +549,7 @@ static gedge_t
 find_aff(graph_t g, gpair_t affectee, gpair_t affected)
 {
 /* find out if when AFFECTEE is updated it affects AFFECTED */
-	if (AFF(g, affectee).x & (1 << (affected - 1))) {
+	if (bs_tst(AFF(g, affectee), affected)) {
 		return affectee;
 	}
 	return NULL_EDGE;
@@ -359,12 +562,14 @@ add_aff(graph_t g, gpair_t affectee, gpair_t affected)
 	gedge_t tmp;
 
 	if ((tmp = find_aff(g, affectee, affected)) == NULL_EDGE &&
-	    (tmp = (gedge_t)affectee) != NULL_EDGE) {
+	    (tmp = (gedge_t)affectee) != NULL_EDGE &&
+	    make_row(g, tmp) == 0) {
 		/* create a new edge */
 		CCY_DEBUG("ctor'ing aff-edge %s%s (%zu) updates affect %zu\n",
 			  P(g, affectee).p.bas->sym,
 			  P(g, affectee).p.trm->sym, affectee, affected);
-		AFF(g, tmp).x |= 1 << (affected - 1);
+		bs_set(AFF(g, tmp), affected);
+		g->adirty = true;
 	}
 	return;
 }
@@ -404,90 +609,298 @@ ccyg_populate(graph_t g)
 	return;
 }
 
+
+/* crosses, path defs of the same pair are kept in two binary heaps,
+ * one ordered by bid and one by ask, so the best route is always
+ * on top and a recomputed path only needs to be sifted into place */
+static double
+path_key(double pri, double qty, unsigned int side)
+{
+/* higher is better on either side, paths without size sink */
+	if (side == 0U) {
+		return qty > 0.0 ? pri : 0.0;
+	}
+	return qty > 0.0 && pri > 0.0 ? -pri : -INFINITY;
+}
+
+static bool
+ghent_better_p(const struct ghent_s *e1, const struct ghent_s *e2)
+{
+	/* at the same price the one that fills more wins */
+	return e1->k > e2->k || (e1->k == e2->k && e1->q > e2->q);
+}
+
+static void
+heap_put(graph_t g, struct ghent_s *h, size_t i, struct ghent_s e,
+	 unsigned int side)
+{
+	h[i] = e;
+	P(g, e.p).hix[side] = i;
+	return;
+}
+
+static void
+heap_upd(graph_t g, gcross_t x, size_t i, unsigned int side,
+	 double pri, double qty)
+{
+/* rekey the path at I and sift it up or down, whichever way it has to go */
+	struct ghent_s *h = X(g, x).h[side];
+	const size_t n = X(g, x).n;
+	struct ghent_s e = {path_key(pri, qty, side), qty, h[i].p};
+
+	if (e.k == h[i].k && e.q == h[i].q) {
+		/* stays where it is */
+		return;
+	}
+	while (i > 0U) {
+		size_t j = (i - 1U) / 2U;
+
+		if (!ghent_better_p(&e, h + j)) {
+			break;
+		}
+		heap_put(g, h, i, h[j], side);
+		i = j;
+	}
+	while (2U * i + 1U < n) {
+		size_t j = 2U * i + 1U;
+
+		if (j + 1U < n && ghent_better_p(h + j + 1U, h + j)) {
+			j++;
+		}
+		if (!ghent_better_p(h + j, &e)) {
+			break;
+		}
+		heap_put(g, h, i, h[j], side);
+		i = j;
+	}
+	heap_put(g, h, i, e, side);
+	return;
+}
+
+gcross_t
+ccyg_find_cross(graph_t g, struct pair_s p)
+{
+	for (gcross_t i = 1; i <= g->ncross; i++) {
+		if (X(g, i).p.bas == p.bas && X(g, i).p.trm == p.trm) {
+			return i;
+		}
+	}
+	return NULL_CROSS;
+}
+
+static gcross_t
+make_cross(graph_t g, struct pair_s p)
+{
+	gcross_t r = g->ncross + 1U;
+
+	if (UNLIKELY(r >= g->alloc_cross)) {
+		size_t nx = g->alloc_cross ? 2U * g->alloc_cross : 8U;
+		struct gcross_s *x;
+
+		if ((x = realloc(g->x, nx * sizeof(*x))) == NULL) {
+			return NULL_CROSS;
+		}
+		memset(x + g->alloc_cross, 0,
+		       (nx - g->alloc_cross) * sizeof(*x));
+		g->x = x;
+		g->alloc_cross = nx;
+	}
+	X(g, r).p = p;
+	return g->ncross = r;
+}
+
+static void
+add_cross_path(graph_t g, gpath_def_t p)
+{
+/* file path def P under the cross of its name */
+	gcross_t x;
+
+	if ((x = ccyg_find_cross(g, P(g, p).p)) == NULL_CROSS &&
+	    (x = make_cross(g, P(g, p).p)) == NULL_CROSS) {
+		return;
+	} else if (X(g, x).n >= X(g, x).alloc) {
+		size_t na = X(g, x).alloc ? 2U * X(g, x).alloc : 16U;
+		struct ghent_s *hb;
+		struct ghent_s *ha;
+
+		if ((hb = realloc(X(g, x).h[0U], na * sizeof(*hb))) == NULL) {
+			return;
+		}
+		X(g, x).h[0U] = hb;
+		if ((ha = realloc(X(g, x).h[1U], na * sizeof(*ha))) == NULL) {
+			return;
+		}
+		X(g, x).h[1U] = ha;
+		X(g, x).alloc = na;
+	}
+	P(g, p).cx = x;
+	/* new paths go in last, unquoted, which is where they belong */
+	heap_put(g, X(g, x).h[0U], X(g, x).n,
+		 (struct ghent_s){0.0, 0.0, p}, 0U);
+	heap_put(g, X(g, x).h[1U], X(g, x).n,
+		 (struct ghent_s){-INFINITY, 0.0, p}, 1U);
+	X(g, x).n++;
+	return;
+}
+
+struct ccyg_tob_s
+ccyg_cross_tob(graph_t g, gcross_t x)
+{
+	struct ccyg_tob_s res = {0.0, 0.0, 0.0, 0.0};
+	const struct ghent_s *e;
+
+	if (x == NULL_CROSS || x > g->ncross || X(g, x).n == 0U) {
+		return res;
+	}
+	if ((e = X(g, x).h[0U])->k > 0.0) {
+		res.bid = e->k;
+		res.bsz = e->q;
+	}
+	if ((e = X(g, x).h[1U])->k > -INFINITY) {
+		res.ask = -e->k;
+		res.asz = e->q;
+	}
+	return res;
+}
+
 
 /* path finder */
-static size_t
-edge_finder(graph_t g, gpair_t x, struct pair_s p)
+#define MAX_HOPS	(8U)
+
+struct pfind_s {
+	/* the pair we're after, and the hop limit */
+	struct pair_s x;
+	size_t maxhops;
+
+	/* current path, CCY[i] is the currency before HOP[i] */
+	size_t nhops;
+	gpair_t hop[MAX_HOPS];
+	const_iso_4217_t ccy[MAX_HOPS + 1U];
+
+	/* path defs created so far */
+	size_t res;
+};
+
+static bool
+path_def_p(graph_t g, gpair_t p)
+{
+	return P(g, p).len > 0U;
+}
+
+static gpath_def_t
+find_path_def(graph_t g, struct pair_s x, const gpair_t *hop, size_t nhops)
+{
+/* find a path def for X along exactly the hops HOP */
+	for (gpair_t i = 1; i <= g->npairs; i++) {
+		if (P(g, i).p.bas != x.bas || P(g, i).p.trm != x.trm) {
+			continue;
+		} else if (P(g, i).len != nhops) {
+			continue;
+		}
+		for (size_t j = 0; j < nhops; j++) {
+			if (F(g, P(g, i).off + j).x != hop[j]) {
+				goto next;
+			}
+		}
+		return i;
+	next:
+		;
+	}
+	return NULL_PATH_HOP;
+}
+
+static void
+add_path_def(graph_t g, struct pfind_s *pf)
 {
 	gpath_def_t def;
-	size_t res = 0;
 
-	for (uint64_t ex = E(g, x).x, i = 1; ex; ex >>= 1, i++) {
-		gpair_t y = (gpair_t)i;
-		struct pair_s cp;
+	if (find_path_def(g, pf->x, pf->hop, pf->nhops) != NULL_PATH_HOP) {
+		/* known already */
+		return;
+	} else if ((def = make_gpath_def(g)) == NULL_PAIR) {
+		return;
+	}
+	CCY_DEBUG("  ... path %zu for %s%s\n",
+		  def, pf->x.bas->sym, pf->x.trm->sym);
+	/* hops go in one after another so they end up contiguous in F */
+	for (size_t i = 0; i < pf->nhops; i++) {
+		CCY_DEBUG("      ... via %s%s\n",
+			  P(g, pf->hop[i]).p.bas->sym,
+			  P(g, pf->hop[i]).p.trm->sym);
+		/* the direction is fixed from now on */
+		add_path_hop(g, def, pf->hop[i],
+			     P(g, pf->hop[i]).p.bas != pf->ccy[i]);
+		add_aff(g, pf->hop[i], def);
+	}
+	/* store the name of this beauty */
+	P(g, def).p = pf->x;
+	add_cross_path(g, def);
+	pf->res++;
+	return;
+}
 
-		if (!(ex & 1)) {
-			continue;
-		} else if ((P(g, y).p.bas == p.bas &&
-			    P(g, y).p.trm == p.trm) ||
-			   (P(g, y).p.bas == p.trm &&
-			    P(g, y).p.trm == p.bas)) {
-			/* glad we had no dramas finding this one */
-			CCY_DEBUG("  ... finally %s%s\n",
-				  P(g, y).p.bas->sym, P(g, y).p.trm->sym);
-			def = make_gpath_def(g);
-			add_path_hop(g, def, y);
-			add_aff(g, y, def);
-			res++;
-			break;
+static gpair_t
+next_cand(graph_t g, gpair_t last, gpair_t y)
+{
+/* candidates for the next hop after LAST, all pairs at the start */
+	if (last == NULL_PAIR) {
+		return y < g->npairs ? y + 1U : NULL_PAIR;
+	}
+	/* path defs get added as we go, so the row is looked up afresh */
+	return bs_next(E(g, last), g->nw, y + 1U);
+}
 
-		} else if (P(g, y).p.bas == p.trm) {
-			cp.bas = P(g, y).p.trm;
-			cp.trm = p.bas;
-		} else if (P(g, y).p.trm == p.trm) {
-			cp.bas = P(g, y).p.bas;
-			cp.trm = p.bas;
+static void
+path_finder(graph_t g, struct pfind_s *pf)
+{
+/* depth-first, extend the current path by every pair that carries on
+ * from its last currency to a currency not visited yet */
+	const_iso_4217_t c = pf->ccy[pf->nhops];
+	gpair_t last = pf->nhops ? pf->hop[pf->nhops - 1U] : NULL_PAIR;
+
+	for (gpair_t y = next_cand(g, last, NULL_PAIR);
+	     y != NULL_PAIR; y = next_cand(g, last, y)) {
+		const_iso_4217_t nx;
+		size_t i;
+
+		if (path_def_p(g, y)) {
+			continue;
+		} else if (P(g, y).p.bas == c) {
+			nx = P(g, y).p.trm;
+		} else if (P(g, y).p.trm == c) {
+			nx = P(g, y).p.bas;
 		} else {
 			continue;
 		}
+		/* no loops, that also means no pair is used twice */
+		for (i = 0; i <= pf->nhops && pf->ccy[i] != nx; i++);
+		if (i <= pf->nhops) {
+			continue;
+		}
 
-		/* 2nd indirection, unrolled */
-		for (uint64_t ey = E(g, y).x, j = 1; ey; ey >>= 1, j++) {
-			gpair_t z = (gpair_t)j;
-
-			if (!(ey & 1)) {
-				;
-			} else if ((P(g, z).p.bas == cp.bas &&
-				    P(g, z).p.trm == cp.trm) ||
-				   (P(g, z).p.bas == cp.trm &&
-				    P(g, z).p.trm == cp.bas)) {
-				/* yep, a very good catch indeed */
-				CCY_DEBUG("  ... finally %s%s\n",
-					  P(g, z).p.bas->sym,
-					  P(g, z).p.trm->sym);
-				def = make_gpath_def(g);
-				add_path_hop(g, def, z);
-				add_aff(g, z, def);
-				res++;
-				goto via;
+		pf->hop[pf->nhops++] = y;
+		pf->ccy[pf->nhops] = nx;
+		if (nx != pf->x.trm) {
+			if (pf->nhops < pf->maxhops) {
+				path_finder(g, pf);
 			}
+		} else if (pf->nhops > 1U) {
+			/* direct quotes are pairs already */
+			add_path_def(g, pf);
 		}
-		continue;
-
-	via:
-		/* here's the chance that we produce multiple path defs
-		 * as the outer loop will be cont'd, however we only
-		 * return the last path_def number (as stored in res)
-		 * nothing breaks really but we can't assign a name to
-		 * the pair in that case */
-		CCY_DEBUG("      ... via %s%s\n",
-			  P(g, y).p.bas->sym, P(g, y).p.trm->sym);
-		add_path_hop(g, def, y);
-		add_aff(g, y, def);
-		CCY_DEBUG("      ... via %s%s\n",
-			  P(g, x).p.bas->sym, P(g, x).p.trm->sym);
-		add_path_hop(g, def, x);
-		add_aff(g, x, def);
+		pf->nhops--;
 	}
-	return res;
+	return;
 }
 
 size_t
-ccyg_add_paths(graph_t g, struct pair_s x)
+ccyg_add_paths_upto(graph_t g, struct pair_s x, size_t maxhops)
 {
-/* adds a virtual pair X from paths found */
-	struct pair_s p = x;
-	size_t ngp = g->npairs;
+/* adds virtual pairs X from paths found */
+	struct pfind_s pf = {
+		.x = x,
+		.maxhops = maxhops < MAX_HOPS ? maxhops : MAX_HOPS,
+	};
 
 	CCY_DEBUG("adding paths XCH %s FOR %s\n", x.bas->sym, x.trm->sym);
 
@@ -495,109 +908,136 @@ ccyg_add_paths(graph_t g, struct pair_s x)
 		/* trivial */
 		return 0;
 	}
-	for (gpair_t i = 1; i <= ngp; i++) {
-		if (P(g, i).p.trm == x.trm) {
-			p.trm = P(g, i).p.bas;
-		} else if (P(g, i).p.bas == x.trm) {
-			p.trm = P(g, i).p.trm;
-		} else {
-			continue;
-		}
-		if (p.bas == p.trm) {
-			CCY_DEBUG("  ... trivial %s%s\n",
-				  P(g, i).p.bas->sym, P(g, i).p.trm->sym);
-			;
-		}
+	pf.ccy[0U] = x.bas;
+	path_finder(g, &pf);
+	return pf.res;
+}
 
-		for (size_t np = edge_finder(g, i, p); np > 0; np--) {
-			/* bit of a hack as we'd have to know that
-			 * path_defs are handed out consecutively and
-			 * off that npairs stack */
-			gpath_def_t f = g->npairs - np + 1;
-
-			CCY_DEBUG("      ... via %s%s  added to %zu\n",
-				  P(g, i).p.bas->sym, P(g, i).p.trm->sym, f);
-			add_path_hop(g, f, i);
-			add_aff(g, i, f);
-			/* store the name of this beauty */
-			P(g, f).p = x;
-		}
-	}
-	return g->npairs - ngp;
+size_t
+ccyg_add_paths(graph_t g, struct pair_s x)
+{
+	return ccyg_add_paths_upto(g, x, CCYG_DFLT_HOPS);
 }
 
 
 /* (re)computing rates */
+static inline v2df
+v2df_min(v2df x, v2df y)
+{
+	return (v2df){y[0] < x[0] ? y[0] : x[0], y[1] < x[1] ? y[1] : x[1]};
+}
+
 static void
 recomp_path(graph_t g, gpath_def_t p)
 {
-	double b, a;
-	const_iso_4217_t ccy;
-
-	/* init and go */
-	b = 1.0;
-	a = 1.0;
-	ccy = P(g, p).p.bas;
-	for (gpair_t i = P(g, p).off; i < P(g, p).off + P(g, p).len; i++) {
-		gpath_hop_t h = F(g, i).x;
-
-		/* from bid(BBBAAA) = 1/ask(AAABBB) and
-		 * for AAABBB and BBBCCC
-		 * bid(AAACCC) = bid(AAABBB) * bid(BBBCCC)
-		 * ask(AAACCC) = ask(AAABBB) * ask(BBBCCC)
-		 *
-		 * it follows:
-		 * for AAABBB and CCCBBB:
-		 * bid(AAACCC) = bid(AAABBB) * 1/ask(CCCBBB)
-		 * ask(AAACCC) = ask(AAABBB) * 1/bid(CCCBBB)
-		 *
-		 * for BBBAAA and BBBCCC::
-		 * bid(AAACCC) = 1/ask(BBBAAA) * bid(BBBCCC)
-		 * ask(AAACCC) = 1/bid(BBBAAA) * ask(BBBCCC)
-		 *
-		 * for BBBAAA and CCCBBB:
-		 * bid(AAACCC) = 1/ask(BBBAAA) * 1/ask(CCCBBB)
-		 * ask(AAACCC) = 1/bid(BBBAAA) * 1/bid(CCCBBB)
-		 *
-		 * which is what the if-tree is all about. */
-
+	v2df r = {1.0, 1.0};
+	v2df u = {1.0, 1.0};
+	v2df z = {INFINITY, INFINITY};
+
+	/* from bid(BBBAAA) = 1/ask(AAABBB) and
+	 * for AAABBB and BBBCCC
+	 * bid(AAACCC) = bid(AAABBB) * bid(BBBCCC)
+	 * ask(AAACCC) = ask(AAABBB) * ask(BBBCCC)
+	 *
+	 * it follows:
+	 * for AAABBB and CCCBBB:
+	 * bid(AAACCC) = bid(AAABBB) * 1/ask(CCCBBB)
+	 * ask(AAACCC) = ask(AAABBB) * 1/bid(CCCBBB)
+	 *
+	 * for BBBAAA and BBBCCC::
+	 * bid(AAACCC) = 1/ask(BBBAAA) * bid(BBBCCC)
+	 * ask(AAACCC) = 1/bid(BBBAAA) * ask(BBBCCC)
+	 *
+	 * for BBBAAA and CCCBBB:
+	 * bid(AAACCC) = 1/ask(BBBAAA) * 1/ask(CCCBBB)
+	 * ask(AAACCC) = 1/bid(BBBAAA) * 1/bid(CCCBBB)
+	 *
+	 * hops know their direction and pairs keep the reciprocals
+	 * handy, so it's just a chain of multiplies of {bid, ask}.
+	 *
+	 * The size along the path is the smallest hop size, each hop's
+	 * size is in the currency we hold before the hop, multiplying
+	 * by the reciprocal rate so far takes it back to the path's bas. */
+	for (gpath_hop_t i = P(g, p).off; i < P(g, p).off + P(g, p).len; i++) {
 		CCY_DEBUG_RECOMP(
 			"  ... %s%s\n",
-			P(g, h).p.bas->sym, P(g, h).p.trm->sym);
-		if (P(g, h).p.bas == ccy) {
-			/* first two cases */
-			b *= P(g, h).b.pri;
-			a *= P(g, h).a.pri;
-			ccy = P(g, h).p.trm;
-		} else if (P(g, h).p.trm == ccy) {
-			/* second two cases */
-			b /= P(g, h).a.pri;
-			a /= P(g, h).b.pri;
-			ccy = P(g, h).p.bas;
-		} else {
-			CCY_DEBUG_RECOMP("can't continue\n");
-			break;
-		}
+			P(g, F(g, i).x).p.bas->sym,
+			P(g, F(g, i).x).p.trm->sym);
+		z = v2df_min(z, S(g, F(g, i).x)[F(g, i).inv] * u);
+		r *= Q(g, F(g, i).x)[F(g, i).inv];
+		u *= U(g, F(g, i).x)[F(g, i).inv];
 	}
 
-	CCY_DEBUG_RECOMP("b %.6f  %.6f a\n", b, a);
-	P(g, p).b.pri = b;
-	P(g, p).a.pri = a;
+	CCY_DEBUG_RECOMP("b %.6f  %.6f a\n", r[0], r[1]);
+	P(g, p).b.pri = r[0];
+	P(g, p).a.pri = r[1];
+	/* no price, no size */
+	P(g, p).b.qty = r[0] > 0.0 ? z[0] : 0.0;
+	P(g, p).a.qty = r[1] > 0.0 ? z[1] : 0.0;
+
+	if (P(g, p).cx != NULL_CROSS) {
+		heap_upd(g, P(g, p).cx, P(g, p).hix[0U], 0U,
+			 P(g, p).b.pri, P(g, p).b.qty);
+		heap_upd(g, P(g, p).cx, P(g, p).hix[1U], 1U,
+			 P(g, p).a.pri, P(g, p).a.qty);
+	}
 	return;
 }
 
-uint64_t
-recomp_affected(graph_t g, gpair_t p)
+static int
+comp_aff(graph_t g)
 {
-	for (uint64_t aff = AFF(g, p).x, j = 1; aff; aff >>= 1, j++) {
-		if ((aff & 1)) {
-			CCY_DEBUG_RECOMP(
-				"+ recomp %s%s (%zu)\n",
-				P(g, j).p.bas->sym, P(g, j).p.trm->sym, j);
-			recomp_path(g, j);
+/* turn the AFF bitsets into per-pair lists of path defs */
+	size_t na = g->npairs + 2U;
+	size_t *aoff;
+	gpath_def_t *alst;
+	size_t n = 0U;
+
+	if ((aoff = realloc(g->aoff, na * sizeof(*aoff))) == NULL) {
+		return -1;
+	}
+	g->aoff = aoff;
+	for (gpair_t i = 0; i <= g->npairs; i++) {
+		aoff[i] = n;
+		if (P(g, i).row > 0U) {
+			n += bs_popcnt(AFF(g, i), g->nw);
+		}
+	}
+	aoff[g->npairs + 1U] = n;
+
+	if ((alst = realloc(g->alst, (n ?: 1U) * sizeof(*alst))) == NULL) {
+		return -1;
+	}
+	g->alst = alst;
+	for (gpair_t i = 1; i <= g->npairs; i++) {
+		size_t k = aoff[i];
+
+		if (P(g, i).row == 0U) {
+			continue;
+		}
+		for (gpair_t j = bs_next(AFF(g, i), g->nw, 1U);
+		     j != NULL_PAIR; j = bs_next(AFF(g, i), g->nw, j + 1U)) {
+			alst[k++] = j;
 		}
 	}
-	return AFF(g, p).x;
+	g->adirty = false;
+	return 0;
+}
+
+size_t
+recomp_affected(graph_t g, gpair_t p)
+{
+	if (UNLIKELY(g->adirty) && comp_aff(g) < 0) {
+		return 0U;
+	}
+	for (size_t i = g->aoff[p]; i < g->aoff[p + 1U]; i++) {
+		CCY_DEBUG_RECOMP(
+			"+ recomp %s%s (%zu)\n",
+			P(g, g->alst[i]).p.bas->sym,
+			P(g, g->alst[i]).p.trm->sym, g->alst[i]);
+		recomp_path(g, g->alst[i]);
+	}
+	return g->aoff[p + 1U] - g->aoff[p];
 }
 
 
@@ -667,10 +1107,8 @@ main(int argc, char *argv[])
 			  P(g, i).p.bas->sym, P(g, i).p.trm->sym,
 			  P(g, i).off, P(g, i).len);
 		CCY_DEBUG("  updates affect:\n");
-		for (uint64_t aff = AFF(g, i).x, j = 1; aff; aff >>= 1, j++) {
-			if (!(aff & 1)) {
-				continue;
-			}
+		for (gpair_t j = bs_next(AFF(g, i), g->nw, 1U);
+		     j != NULL_PAIR; j = bs_next(AFF(g, i), g->nw, j + 1U)) {
 			CCY_DEBUG("  + %s%s (%zu)\n",
 				  P(g, j).p.bas->sym, P(g, j).p.trm->sym, j);
 		}
@@ -687,17 +1125,21 @@ main(int argc, char *argv[])
 		gpair_t p;
 
 		if ((p = ccyg_find_pair(g, EURUSD)) != NULL_PAIR) {
-			P(g, p).b.pri = 1.22305 + (double)i / 10000.0;
-			P(g, p).b.qty = 13.0 + (double)i / 100.0;
-			P(g, p).a.pri = 1.22309 + (double)i / 10000.0;
-			P(g, p).a.qty = 13.0 + (double)i / 100.0;
+			upd_bid(g, p,
+				1.22305 + (double)i / 10000.0,
+				13.0 + (double)i / 100.0);
+			upd_ask(g, p,
+				1.22309 + (double)i / 10000.0,
+				13.0 + (double)i / 100.0);
 		}
 
 		if ((p = ccyg_find_pair(g, AUDUSD)) != NULL_PAIR) {
-			P(g, p).b.pri = 1.0250 + (double)i / 10000.0;
-			P(g, p).b.qty = 11.0 + (double)i / 100.0;
-			P(g, p).a.pri = 1.02517 + (double)i / 100.0;
-			P(g, p).a.qty = 13.0 + (double)i / 100.0;
+			upd_bid(g, p,
+				1.0250 + (double)i / 10000.0,
+				11.0 + (double)i / 100.0);
+			upd_ask(g, p,
+				1.02517 + (double)i / 100.0,
+				13.0 + (double)i / 100.0);
 		}
 
 		if ((p = ccyg_find_pair(
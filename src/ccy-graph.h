@@ -49,7 +49,8 @@ typedef size_t gnode_t;
 typedef size_t gedge_t;
 typedef size_t gpath_def_t;
 typedef size_t gpath_hop_t;
-typedef union graph_u *graph_t;
+typedef size_t gcross_t;
+typedef struct graph_s *graph_t;
 
 struct pair_s {
 	const_iso_4217_t bas;
@@ -59,6 +60,18 @@ struct pair_s {
 #define NULL_PAIR	((gpair_t)0)
 #define NULL_EDGE	((gedge_t)0)
 #define NULL_PATH_HOP	((gpath_def_t)0)
+#define NULL_CROSS	((gcross_t)0)
+
+/* best path bid and ask of a cross and the size they're good for */
+struct ccyg_tob_s {
+	double bid;
+	double bsz;
+	double ask;
+	double asz;
+};
+
+/* default length limit of paths */
+#define CCYG_DFLT_HOPS	(3U)
 
 
 extern graph_t make_graph(void);
@@ -78,6 +91,25 @@ extern void ccyg_populate(graph_t);
  * On success this returns the number of pairs added to the graph. */
 extern size_t ccyg_add_paths(graph_t, struct pair_s);
 
+/**
+ * Like ccyg_add_paths() but consider paths of up to MAXHOPS pairs,
+ * ccyg_add_paths() goes up to CCYG_DFLT_HOPS.
+ * Paths visit every currency at most once and are only added once. */
+extern size_t ccyg_add_paths_upto(graph_t, struct pair_s, size_t maxhops);
+
+/**
+ * Return the cross (all path defs) of pair P, NULL_CROSS if no paths
+ * have been added for P. */
+extern gcross_t ccyg_find_cross(graph_t, struct pair_s p);
+
+/**
+ * Return the best bid and ask over all paths of cross X together with
+ * the sizes (in the base currency) executable along the chosen paths.
+ * Paths without size on a side are never chosen for it, a side with
+ * no such path is all zeroes.
+ * This is kept up to date by recomp_affected() and costs nothing. */
+extern struct ccyg_tob_s ccyg_cross_tob(graph_t, gcross_t x);
+
 #if defined DEBUG_FLAG
 extern void prnt_graph(graph_t);
 #endif	/* DEBUG_FLAG */
@@ -89,7 +121,10 @@ extern void upd_ask(graph_t g, gpair_t p, double pri, double qty);
 extern double get_bid(graph_t g, gpair_t p);
 extern double get_ask(graph_t g, gpair_t p);
 
-extern uint64_t recomp_affected(graph_t g, gpair_t p);
+/**
+ * Recompute all path defs affected by an update of P.
+ * Return the number of path defs recomputed. */
+extern size_t recomp_affected(graph_t g, gpair_t p);
 
 #if defined __cplusplus
 }
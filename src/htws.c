@@ -5,10 +5,12 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 /* for *to* macroes */
 #include <netinet/in.h>
 
 #include "md5.h"
+#include "sha1.h"
 #include "nifty.h"
 #include "htws.h"
 
@@ -211,4 +213,143 @@ Connection: Upgrade\r\n\
 	return 0;
 }
 
+
+/* rfc 6455 */
+static size_t
+b64(char *restrict tgt, const uint8_t *src, size_t ssz)
+{
+	static const char alpha[] = "\
+ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char *tp = tgt;
+
+	for (; ssz >= 3U; src += 3U, ssz -= 3U) {
+		*tp++ = alpha[src[0] >> 2U];
+		*tp++ = alpha[((src[0] & 0x03U) << 4U) | (src[1] >> 4U)];
+		*tp++ = alpha[((src[1] & 0x0fU) << 2U) | (src[2] >> 6U)];
+		*tp++ = alpha[src[2] & 0x3fU];
+	}
+	if (ssz) {
+		*tp++ = alpha[src[0] >> 2U];
+		if (ssz == 1U) {
+			*tp++ = alpha[(src[0] & 0x03U) << 4U];
+			*tp++ = '=';
+		} else {
+			*tp++ = alpha[((src[0] & 0x03U) << 4U) | (src[1] >> 4U)];
+			*tp++ = alpha[(src[1] & 0x0fU) << 2U];
+		}
+		*tp++ = '=';
+	}
+	return tp - tgt;
+}
+
+ssize_t
+ws_accept(char *restrict tgt, size_t tsz, const char *msg)
+{
+	static const char cookie[] = "\r\nSec-WebSocket-Key:";
+	static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	static const char rsp[] = "\
+HTTP/1.1 101 Switching Protocols\r\n\
+Upgrade: websocket\r\n\
+Connection: Upgrade\r\n\
+Sec-WebSocket-Accept: ";
+	/* key and guid, then digest */
+	char kbuf[64 + sizeof(guid)];
+	uint8_t dgst[SHA1_DIGEST_SIZE];
+	const char *key;
+	size_t kz;
+	size_t z;
+
+	if (UNLIKELY((key = strcasestr(msg, cookie)) == NULL)) {
+		/* no rfc 6455 client */
+		return -1;
+	}
+	for (key += sizeof(cookie) - 1; *key == ' ' || *key == '\t'; key++);
+	for (kz = 0U; key[kz] > ' '; kz++);
+	if (UNLIKELY(kz == 0U || kz > 64U)) {
+		return -1;
+	} else if (tsz < sizeof(rsp) - 1 + 28U/*b64 of sha1*/ + 4U) {
+		return -1;
+	}
+	memcpy(kbuf, key, kz);
+	memcpy(kbuf + kz, guid, sizeof(guid) - 1);
+	sha1(dgst, kbuf, kz + sizeof(guid) - 1);
+
+	memcpy(tgt, rsp, z = sizeof(rsp) - 1);
+	z += b64(tgt + z, dgst, sizeof(dgst));
+	memcpy(tgt + z, "\r\n\r\n", 4U);
+	return z + 4U;
+}
+
+size_t
+ws_frame_hdr(char *restrict tgt, unsigned int op, size_t plz)
+{
+	uint8_t *tp = (uint8_t*)tgt;
+
+	/* always FIN, never masked */
+	tp[0] = (uint8_t)(0x80U | (op & 0x0fU));
+	if (plz < 126U) {
+		tp[1] = (uint8_t)plz;
+		return 2U;
+	} else if (plz < 65536U) {
+		tp[1] = 126U;
+		tp[2] = (uint8_t)(plz >> 8U);
+		tp[3] = (uint8_t)plz;
+		return 4U;
+	}
+	tp[1] = 127U;
+	for (unsigned int i = 0; i < 8U; i++) {
+		tp[9U - i] = (uint8_t)((uint64_t)plz >> (8U * i));
+	}
+	return 10U;
+}
+
+ssize_t
+ws_frame_dec(struct ws_frame_s *tgt, char *buf, size_t bsz)
+{
+	const uint8_t *bp = (const uint8_t*)buf;
+	size_t hz = 2U;
+	uint64_t plz;
+	uint8_t msk[4];
+
+	if (bsz < hz) {
+		return 0;
+	} else if (!(bp[1] & 0x80U)) {
+		/* clients must mask */
+		return -1;
+	}
+	switch ((plz = bp[1] & 0x7fU)) {
+	case 126U:
+		if (bsz < (hz += 2U)) {
+			return 0;
+		}
+		plz = (uint64_t)bp[2] << 8U | bp[3];
+		break;
+	case 127U:
+		if (bsz < (hz += 8U)) {
+			return 0;
+		}
+		plz = 0U;
+		for (unsigned int i = 2U; i < 10U; i++) {
+			plz = plz << 8U | bp[i];
+		}
+		break;
+	default:
+		break;
+	}
+	if (bsz < hz + 4U || bsz - hz - 4U < plz) {
+		return 0;
+	}
+	memcpy(msk, bp + hz, sizeof(msk));
+	hz += sizeof(msk);
+
+	tgt->fin = (bp[0] & 0x80U) != 0U;
+	tgt->op = bp[0] & 0x0fU;
+	tgt->pl = buf + hz;
+	tgt->plz = (size_t)plz;
+	for (size_t i = 0; i < tgt->plz; i++) {
+		tgt->pl[i] ^= msk[i % 4U];
+	}
+	return hz + tgt->plz;
+}
+
 /* htws.c ends here */
@@ -1,6 +1,45 @@
 #if !defined INCLUDED_htws_h_
 #define INCLUDED_htws_h_
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* websocket opcodes, rfc 6455 */
+#define WS_OP_CONT	(0x0U)
+#define WS_OP_TEXT	(0x1U)
+#define WS_OP_BINARY	(0x2U)
+#define WS_OP_CLOSE	(0x8U)
+#define WS_OP_PING	(0x9U)
+#define WS_OP_PONG	(0xaU)
+
+/* maximum size of a server frame header */
+#define WS_HDR_MAXZ	(10U)
+
+struct ws_frame_s {
+	unsigned int op;
+	bool fin;
+	char *pl;
+	size_t plz;
+};
+
 extern int wsget_challenge(int fd, char *msg, size_t msglen);
 
+/**
+ * Write the rfc 6455 handshake reply to the upgrade request MSG into TGT.
+ * MSG must be nul-terminated.  Return the reply's length or -1 if MSG
+ * is no (supported) websocket handshake. */
+extern ssize_t ws_accept(char *restrict tgt, size_t tsz, const char *msg);
+
+/**
+ * Write an unmasked frame header for a payload of PLZ bytes into TGT,
+ * which must hold WS_HDR_MAXZ bytes.  Return the header's length. */
+extern size_t ws_frame_hdr(char *restrict tgt, unsigned int op, size_t plz);
+
+/**
+ * Decode the client frame in BUF (of size BSZ) into TGT and unmask its
+ * payload in place.  Return the frame's size, 0 if BUF holds only part
+ * of it or -1 if it isn't a proper client frame. */
+extern ssize_t ws_frame_dec(struct ws_frame_s *tgt, char *buf, size_t bsz);
+
 #endif	/* !INCLUDED_htws_h_ */
@@ -6,15 +6,26 @@
 #define ROUND_PGSZ(_x)	(((_x) / PGSZ + 1) * PGSZ)
 #define MAP_MEM		(MAP_PRIVATE | MAP_ANONYMOUS)
 #define PROT_MEM	(PROT_READ | PROT_WRITE)
+/* cells are rounded up to and aligned on cache lines */
+#define CLSZ		(64U)
+#define ROUND_CLSZ(_x)	((((_x) + CLSZ - 1U) / CLSZ) * CLSZ)
 
 typedef struct mmls_s *mmls_t;
 typedef struct mmls_cell_s *mmls_cell_t;
+typedef struct mmls_chunk_s *mmls_chunk_t;
 
 struct mmls_s {
 	mmls_cell_t head;
-	uint32_t len;
-	uint32_t csz;
-	char data[];
+	/* chain of mapped chunks, most recent first */
+	mmls_chunk_t chunks;
+	/* cell size, a multiple of CLSZ */
+	size_t csz;
+	/* number of cells per chunk */
+	size_t ncpc;
+	/* cells in total, cells handed out, and the maximum thereof */
+	size_t ncell;
+	size_t nused;
+	size_t hiwat;
 };
 
 /* that's how we imagine cells look like */
@@ -23,48 +34,89 @@ struct mmls_cell_s {
 	char data[];
 };
 
+/* chunk header, occupies the first cache line of every chunk */
+struct mmls_chunk_s {
+	mmls_chunk_t prev;
+	size_t len;
+};
+
 
-static void
-__chain_mmls(mmls_t m, size_t len, size_t cell_size)
+static int
+__grow_mmls(mmls_t m)
 {
-	size_t cszp = cell_size / sizeof(void*);
-	mmls_cell_t p = m->head;
+/* map another chunk and chain its cells onto the free list */
+	size_t len = ROUND_PGSZ(CLSZ + m->ncpc * m->csz);
+	mmls_chunk_t c;
+	char *sp;
+	char *ep;
 
-	for (mmls_cell_t o = p + cszp, ep = (void*)((char*)m + len);
-		o < ep; p->next = o, p = o, o += cszp);
-	p->next = NULL;
-	return;
+	if ((c = mmap(NULL, len, PROT_MEM, MAP_MEM, -1, 0)) == MAP_FAILED) {
+		return -1;
+	}
+	c->prev = m->chunks;
+	c->len = len;
+	m->chunks = c;
+
+	/* everything after the header, in csz strides, as far as it fits */
+	sp = (char*)c + CLSZ;
+	ep = (char*)c + len;
+	for (; sp + m->csz <= ep; sp += m->csz, m->ncell++) {
+		mmls_cell_t o = (void*)sp;
+
+		o->next = m->head;
+		m->head = o;
+	}
+	return 0;
 }
 
 static mmls_t
 make_mmls(size_t cell_size, size_t count)
 {
 	mmls_t res;
-	uint32_t len = ROUND_PGSZ(count * cell_size + sizeof(*res));
-
-	res = mmap(NULL, len, PROT_MEM, MAP_MEM, 0, 0);
-	res->len = len;
-	res->csz = (uint32_t)cell_size;
-	res->head = (void*)((char*)res + sizeof(*res));
-	/* chain the stuff together initially */
-	__chain_mmls(res, len, cell_size);
+
+	if ((res = malloc(sizeof(*res))) == NULL) {
+		return NULL;
+	}
+	res->head = NULL;
+	res->chunks = NULL;
+	res->csz = ROUND_CLSZ(cell_size);
+	res->ncpc = count ? count : 1U;
+	res->ncell = res->nused = res->hiwat = 0U;
+	/* get the first chunk now so the common case never grows */
+	if (__grow_mmls(res) < 0) {
+		free(res);
+		return NULL;
+	}
 	return res;
 }
 
 static void
 free_mmls(mmls_t m)
 {
-	munmap(m, m->len);
+	for (mmls_chunk_t c = m->chunks, p; c != NULL; c = p) {
+		p = c->prev;
+		munmap(c, c->len);
+	}
+	free(m);
 	return;
 }
 
 static void*
 mmls_pop_cell(mmls_t m)
 {
-	mmls_cell_t res = m->head;
+	mmls_cell_t res;
+
+	if (m->head == NULL && __grow_mmls(m) < 0) {
+		/* out of memory */
+		return NULL;
+	}
+	res = m->head;
 	m->head = res->next;
 	/* clear out the old next pointer */
 	res->next = NULL;
+	if (++m->nused > m->hiwat) {
+		m->hiwat = m->nused;
+	}
 	return (void*)res;
 }
 
@@ -74,7 +126,15 @@ mmls_push_cell(mmls_t m, void *cell)
 	mmls_cell_t c = (void*)cell;
 	c->next = m->head;
 	m->head = c;
+	m->nused--;
 	return;
 }
 
+static __attribute__((unused)) size_t
+mmls_hiwat(mmls_t m)
+{
+/* return the maximum number of cells ever handed out simultaneously */
+	return m->hiwat;
+}
+
 /* mmls.c ends here */
@@ -0,0 +1,393 @@
+/*** oq-bench.c -- order queue microbenchmark
+ *
+ * Copyright (C) 2012-2013 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of unsermarkt.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include "oq.h"
+#include "nifty.h"
+
+/* reference price and tick size */
+#define MID	(100.)
+#define TICK	(0.01)
+
+typedef enum {
+	DIST_UNIFORM,
+	DIST_NORMAL,
+} dist_t;
+
+struct bench_s {
+	size_t n;
+	size_t depth;
+	size_t prefill;
+	double cancel;
+	double cross;
+	dist_t dist;
+	bool ladderp;
+
+	/* prices, 2 * depth + 1 of them, MID in the middle */
+	m30_t *px;
+
+	/* xorshift state */
+	uint64_t rs;
+
+	/* oids we believe are still resting */
+	oid_t *live;
+	size_t nlive;
+
+	/* latencies in nanoseconds, per operation kind */
+	uint32_t *ladd;
+	size_t nadd;
+	uint32_t *lcan;
+	size_t ncan;
+	size_t nmiss;
+	size_t nmatch;
+};
+
+
+static void
+__attribute__((format(printf, 2, 3)))
+error(int eno, const char *fmt, ...)
+{
+	va_list vap;
+	va_start(vap, fmt);
+	fputs("[oq-bench]: ", stderr);
+	vfprintf(stderr, fmt, vap);
+	va_end(vap);
+	if (eno) {
+		fputc(':', stderr);
+		fputc(' ', stderr);
+		fputs(strerror(eno), stderr);
+	}
+	fputc('\n', stderr);
+	return;
+}
+
+static inline uint64_t
+rnd(struct bench_s *b)
+{
+	uint64_t x = b->rs;
+
+	x ^= x << 13U;
+	x ^= x >> 7U;
+	x ^= x << 17U;
+	return b->rs = x;
+}
+
+static inline double
+rnd_unif(struct bench_s *b)
+{
+/* uniform on [0, 1) */
+	return (double)(rnd(b) >> 11U) / 9007199254740992.;
+}
+
+static size_t
+rnd_off(struct bench_s *b)
+{
+/* distance from MID in ticks, between 1 and depth */
+	size_t res;
+
+	switch (b->dist) {
+	default:
+	case DIST_UNIFORM:
+		res = (size_t)(rnd_unif(b) * (double)b->depth);
+		break;
+	case DIST_NORMAL: {
+		/* half-normal with most of the mass on the top quarter */
+		double u = rnd_unif(b) ?: 1e-12;
+		double v = rnd_unif(b);
+		double z = sqrt(-2. * log(u)) * cos(2. * M_PI * v);
+
+		res = (size_t)(fabs(z) * (double)b->depth / 4.);
+		break;
+	}
+	}
+	return (res < b->depth ? res : b->depth - 1U) + 1U;
+}
+
+static struct umo_s
+rnd_order(struct bench_s *b)
+{
+	struct umo_s o = {
+		.agent_id = 1U,
+		.instr_id = 1U,
+		.q = 1U + (uint32_t)(rnd(b) % 100U),
+		.type = OTYPE_LIM,
+		.tymod = OTYMOD_GTC,
+	};
+	size_t off = rnd_off(b);
+	bool crossp = rnd_unif(b) < b->cross;
+
+	/* bids below MID, asks above, unless they're supposed to cross */
+	if (rnd(b) & 1U) {
+		o.side = OSIDE_BUY;
+		o.p = b->px[crossp ? b->depth + off : b->depth - off];
+	} else {
+		o.side = OSIDE_SELL;
+		o.p = b->px[crossp ? b->depth - off : b->depth + off];
+	}
+	return o;
+}
+
+static inline uint64_t
+now_ns(void)
+{
+	struct timespec ts[1];
+
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static void
+count_matches(const struct umm_s *UNUSED(ms), size_t nms, void *clo)
+{
+	struct bench_s *b = clo;
+
+	b->nmatch += nms;
+	return;
+}
+
+static void
+add1(struct bench_s *b, umoq_t q, bool timedp)
+{
+	struct umo_s o = rnd_order(b);
+	uint64_t t0 = now_ns();
+	oid_t oid = oq_add_order(q, &o);
+	uint64_t t1 = now_ns();
+
+	if (oid > 0U) {
+		b->live[b->nlive++] = oid;
+	}
+	if (timedp) {
+		b->ladd[b->nadd++] = (uint32_t)(t1 - t0);
+	}
+	return;
+}
+
+static void
+can1(struct bench_s *b, umoq_t q)
+{
+	size_t i = rnd(b) % b->nlive;
+	oid_t oid = b->live[i];
+	uint64_t t0;
+	uint64_t t1;
+	int rc;
+
+	b->live[i] = b->live[--b->nlive];
+	t0 = now_ns();
+	rc = oq_cancel_order(q, oid);
+	t1 = now_ns();
+
+	/* the order might have been matched in the meantime */
+	b->nmiss += rc < 0;
+	b->lcan[b->ncan++] = (uint32_t)(t1 - t0);
+	return;
+}
+
+static int
+u32cmp(const void *x, const void *y)
+{
+	const uint32_t *a = x;
+	const uint32_t *b = y;
+	return (*a > *b) - (*a < *b);
+}
+
+static void
+prnt_lat(const char *what, uint32_t *l, size_t n)
+{
+	if (n == 0U) {
+		printf("%-8s %10zu\n", what, n);
+		return;
+	}
+	qsort(l, n, sizeof(*l), u32cmp);
+	printf("%-8s %10zu  p50 %6u ns  p99 %6u ns  p99.9 %6u ns  max %u ns\n",
+	       what, n,
+	       l[(n - 1U) * 50U / 100U],
+	       l[(n - 1U) * 99U / 100U],
+	       l[(n - 1U) * 999U / 1000U],
+	       l[n - 1U]);
+	return;
+}
+
+static int
+bench(struct bench_s *b)
+{
+	umoq_t q;
+	struct oq_hiwat_s hw;
+	uint64_t beg;
+	uint64_t end;
+
+	if ((q = make_oq(1U, 1U)) == NULL) {
+		error(errno, "cannot create order queue");
+		return -1;
+	} else if (b->ladderp &&
+		   oq_set_ladder(q, b->px[0U], ffff_m30_get_d(TICK),
+				 2U * b->depth + 1U) < 0) {
+		error(0, "cannot set up tick ladder");
+		free_oq(q);
+		return -1;
+	}
+	oq_register_matches_cb(q, count_matches, b);
+
+	/* rest some orders first so cancels have something to chew on */
+	for (size_t i = 0; i < b->prefill; i++) {
+		add1(b, q, false);
+	}
+	b->nmatch = 0U;
+
+	beg = now_ns();
+	for (size_t i = 0; i < b->n; i++) {
+		if (b->nlive > 0U && rnd_unif(b) < b->cancel) {
+			can1(b, q);
+		} else {
+			add1(b, q, true);
+		}
+	}
+	end = now_ns();
+
+	printf("ops      %10zu  %.6f s  %.0f ops/s\n",
+	       b->n, (double)(end - beg) / 1e9,
+	       (double)b->n * 1e9 / (double)(end - beg));
+	prnt_lat("add", b->ladd, b->nadd);
+	prnt_lat("cancel", b->lcan, b->ncan);
+	printf("matches  %10zu\n", b->nmatch);
+	printf("misses   %10zu\n", b->nmiss);
+	hw = oq_get_hiwat(q);
+	printf("hiwat    %10zu orders  %zu levels  %zu matches\n",
+	       hw.nord, hw.nlev, hw.nmat);
+	free_oq(q);
+	return 0;
+}
+
+
+#include "oq-bench.yucc"
+
+int
+main(int argc, char *argv[])
+{
+	yuck_t argi[1U];
+	struct bench_s b[1] = {{
+			.n = 1000000U,
+			.depth = 100U,
+			.cancel = 0.3,
+			.cross = 0.05,
+			.dist = DIST_UNIFORM,
+			.rs = 1U,
+		}};
+	int rc = 0;
+
+	/* parse the command line */
+	if (yuck_parse(argi, argc, argv)) {
+		rc = 1;
+		goto out;
+	}
+
+	if (argi->count_arg) {
+		b->n = strtoul(argi->count_arg, NULL, 0);
+	}
+	if (argi->depth_arg) {
+		b->depth = strtoul(argi->depth_arg, NULL, 0) ?: 1U;
+	}
+	if ((double)b->depth * TICK >= MID) {
+		error(0, "depth must be less than %.0f", MID / TICK);
+		rc = 1;
+		goto out;
+	}
+	if (argi->cancel_arg) {
+		b->cancel = strtod(argi->cancel_arg, NULL);
+	}
+	if (argi->cross_arg) {
+		b->cross = strtod(argi->cross_arg, NULL);
+	}
+	if (argi->dist_arg == NULL) {
+		;
+	} else if (!strcmp(argi->dist_arg, "uniform")) {
+		b->dist = DIST_UNIFORM;
+	} else if (!strcmp(argi->dist_arg, "normal")) {
+		b->dist = DIST_NORMAL;
+	} else {
+		error(0, "unknown price distribution `%s'", argi->dist_arg);
+		rc = 1;
+		goto out;
+	}
+	b->prefill = argi->prefill_arg
+		? strtoul(argi->prefill_arg, NULL, 0) : 10U * b->depth;
+	if (argi->seed_arg) {
+		b->rs = strtoull(argi->seed_arg, NULL, 0) ?: 1U;
+	}
+	b->ladderp = argi->ladder_flag;
+
+	/* price grid, MID right in the middle */
+	b->px = malloc((2U * b->depth + 1U) * sizeof(*b->px));
+	b->live = malloc((b->prefill + b->n) * sizeof(*b->live));
+	b->ladd = malloc(b->n * sizeof(*b->ladd));
+	b->lcan = malloc(b->n * sizeof(*b->lcan));
+	if (b->px == NULL || b->live == NULL ||
+	    b->ladd == NULL || b->lcan == NULL) {
+		error(errno, "cannot allocate benchmark buffers");
+		rc = 1;
+		goto fr;
+	}
+	for (size_t i = 0; i <= 2U * b->depth; i++) {
+		double p = MID + ((double)i - (double)b->depth) * TICK;
+		b->px[i] = ffff_m30_get_d(p);
+	}
+
+	if (bench(b) < 0) {
+		rc = 1;
+	}
+
+fr:
+	free(b->px);
+	free(b->live);
+	free(b->ladd);
+	free(b->lcan);
+out:
+	/* free up command line parser resources */
+	yuck_free(argi);
+	return rc;
+}
+
+/* oq-bench.c ends here */
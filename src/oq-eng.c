@@ -0,0 +1,507 @@
+/*** oq-eng.c -- order queues of many instruments, sharded over threads
+ *
+ * Copyright (C) 2012-2013 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of unsermarkt.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include "oq-eng.h"
+#include "nifty.h"
+
+/* slots per ring, must be a power of 2 */
+#define OQE_NSLOT	(65536U)
+/* orders processed per round */
+#define OQE_BATCH	(256U)
+
+typedef struct oqe_wrk_s *oqe_wrk_t;
+
+/* single-producer/single-consumer ring of fixed-size elements */
+struct oqe_ring_s {
+	char *s;
+	size_t z;
+
+	/* producer side */
+	size_t head __attribute__((aligned(64)));
+	/* consumer side */
+	size_t tail __attribute__((aligned(64)));
+};
+
+typedef enum {
+	OQE_ADD,
+	OQE_CANCEL,
+} oqe_op_t;
+
+struct oqe_msg_s {
+	oqe_op_t op;
+	oid_t oid;
+	uint64_t ref;
+	struct umo_s o;
+};
+
+struct oqe_book_s {
+	insid_t ins;
+	umoq_t q;
+};
+
+struct oqe_wrk_s {
+	oqe_t e;
+	size_t idx;
+	pthread_t thr;
+
+	/* our books, open addressing on the instrument id */
+	struct oqe_book_s *bk;
+	size_t nbk;
+	size_t zbk;
+
+	/* orders in, matches and acks out */
+	struct oqe_ring_s in[1];
+	struct oqe_ring_s out[1];
+	struct oqe_ring_s ack[1];
+
+	/* napping and quitting */
+	pthread_mutex_t mtx;
+	pthread_cond_t cnd;
+	int zzz;
+	bool quit;
+};
+
+struct oqe_s {
+	insid_t funid;
+	size_t nwrk;
+	/* round-robin starts for oqe_matches() and oqe_acks() */
+	size_t rr;
+	size_t arr;
+	struct oqe_wrk_s wrk[];
+};
+
+
+static int
+init_ring(struct oqe_ring_s *r, size_t z)
+{
+	if ((r->s = malloc(OQE_NSLOT * z)) == NULL) {
+		return -1;
+	}
+	r->z = z;
+	r->head = r->tail = 0U;
+	return 0;
+}
+
+static void
+fini_ring(struct oqe_ring_s *r)
+{
+	free(r->s);
+	r->s = NULL;
+	return;
+}
+
+static int
+ring_put(struct oqe_ring_s *r, const void *p)
+{
+	size_t h = r->head;
+
+	if (UNLIKELY(h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >=
+		     OQE_NSLOT)) {
+		return -1;
+	}
+	memcpy(r->s + (h % OQE_NSLOT) * r->z, p, r->z);
+	__atomic_store_n(&r->head, h + 1U, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+static size_t
+ring_get(struct oqe_ring_s *r, void *tgt, size_t n)
+{
+	size_t t = r->tail;
+	size_t h = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	size_t i;
+
+	for (i = 0U; t + i != h && i < n; i++) {
+		memcpy((char*)tgt + i * r->z,
+		       r->s + ((t + i) % OQE_NSLOT) * r->z, r->z);
+	}
+	__atomic_store_n(&r->tail, t + i, __ATOMIC_RELEASE);
+	return i;
+}
+
+static int
+wrk_put(oqe_wrk_t w, struct oqe_ring_s *r, const void *p)
+{
+/* put P into out-going ring R, waiting for the consumer if need be */
+	while (UNLIKELY(ring_put(r, p) < 0)) {
+		/* wait for the consumer, unless we're going down */
+		if (__atomic_load_n(&w->quit, __ATOMIC_ACQUIRE)) {
+			return -1;
+		}
+		sched_yield();
+	}
+	return 0;
+}
+
+static void
+wrk_matches(const struct umm_s *ms, size_t nms, void *clo)
+{
+/* match callback of all our books, forward MS to the match queue */
+	oqe_wrk_t w = clo;
+
+	for (size_t i = 0U; i < nms && wrk_put(w, w->out, ms + i) == 0; i++);
+	return;
+}
+
+static void
+wrk_ack(oqe_wrk_t w, const struct oqe_msg_s *m, oid_t oid, umost_t st)
+{
+	struct oqe_ack_s a = {
+		.ref = m->ref,
+		.ins = m->o.instr_id,
+		.oid = oid,
+		.st = st,
+	};
+
+	(void)wrk_put(w, w->ack, &a);
+	return;
+}
+
+
+/* books */
+static inline size_t
+book_slot(oqe_wrk_t w, insid_t ins)
+{
+	size_t i = (ins * 2654435761U) & (w->zbk - 1U);
+
+	while (w->bk[i].q != NULL && w->bk[i].ins != ins) {
+		i = (i + 1U) & (w->zbk - 1U);
+	}
+	return i;
+}
+
+static umoq_t
+book(oqe_wrk_t w, insid_t ins)
+{
+	size_t i;
+
+	if (UNLIKELY(2U * (w->nbk + 1U) > w->zbk)) {
+		/* rehash */
+		struct oqe_book_s *ob = w->bk;
+		size_t oz = w->zbk;
+		size_t nz = oz ? oz * 2U : 64U;
+
+		if ((w->bk = calloc(nz, sizeof(*w->bk))) == NULL) {
+			w->bk = ob;
+			return NULL;
+		}
+		w->zbk = nz;
+		for (size_t j = 0U; j < oz; j++) {
+			if (ob[j].q != NULL) {
+				w->bk[book_slot(w, ob[j].ins)] = ob[j];
+			}
+		}
+		free(ob);
+	}
+	if (w->bk[i = book_slot(w, ins)].q == NULL) {
+		/* first order for INS */
+		if ((w->bk[i].q = make_oq(ins, w->e->funid)) == NULL) {
+			return NULL;
+		}
+		w->bk[i].ins = ins;
+		w->nbk++;
+		oq_register_matches_cb(w->bk[i].q, wrk_matches, w);
+	}
+	return w->bk[i].q;
+}
+
+
+/* workers */
+static void
+wrk_pin(oqe_wrk_t w)
+{
+#if defined CPU_SET
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t cs;
+
+	if (ncpu > 0) {
+		CPU_ZERO(&cs);
+		CPU_SET(w->idx % (size_t)ncpu, &cs);
+		pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs);
+	}
+#else  /* !CPU_SET */
+	/* leave it to the scheduler */
+	(void)w;
+#endif	/* CPU_SET */
+	return;
+}
+
+static void
+wrk_proc(oqe_wrk_t w, const struct oqe_msg_s *m, size_t nm)
+{
+	struct umo_s os[OQE_BATCH];
+	oid_t oids[OQE_BATCH];
+
+	for (size_t i = 0U, j; i < nm; i = j) {
+		umoq_t q;
+
+		if ((q = book(w, m[i].o.instr_id)) == NULL) {
+			/* can't do nothing about this */
+			wrk_ack(w, m + i, m[i].oid, OSTATUS_REJ);
+			j = i + 1U;
+			continue;
+		}
+		switch (m[i].op) {
+		case OQE_ADD:
+			/* collect the run of orders for this book */
+			for (j = i; j < nm && m[j].op == OQE_ADD &&
+				     m[j].o.instr_id == m[i].o.instr_id; j++) {
+				os[j - i] = m[j].o;
+			}
+			oq_add_orders(q, oids, os, j - i);
+			for (size_t k = i; k < j; k++) {
+				oid_t oid = oids[k - i];
+
+				wrk_ack(w, m + k, oid,
+					oid ? oq_get_status(q, oid) : OSTATUS_UNK);
+			}
+			break;
+		case OQE_CANCEL:
+			wrk_ack(w, m + i, m[i].oid,
+				oq_cancel_order(q, m[i].oid) == 0
+				? OSTATUS_CANC : OSTATUS_REJ);
+			j = i + 1U;
+			break;
+		default:
+			j = i + 1U;
+			break;
+		}
+	}
+	return;
+}
+
+static void*
+wrk(void *clo)
+{
+	oqe_wrk_t w = clo;
+	struct oqe_msg_s m[OQE_BATCH];
+
+	wrk_pin(w);
+	for (;;) {
+		struct timespec ts[1];
+		size_t n;
+
+		if ((n = ring_get(w->in, m, countof(m)))) {
+			wrk_proc(w, m, n);
+			continue;
+		} else if (__atomic_load_n(&w->quit, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		/* nothing to do, have a nap */
+		clock_gettime(CLOCK_REALTIME, ts);
+		if ((ts->tv_nsec += 1000000L) >= 1000000000L) {
+			ts->tv_sec++;
+			ts->tv_nsec -= 1000000000L;
+		}
+		pthread_mutex_lock(&w->mtx);
+		__atomic_store_n(&w->zzz, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&w->in->head, __ATOMIC_SEQ_CST) ==
+		    w->in->tail &&
+		    !__atomic_load_n(&w->quit, __ATOMIC_ACQUIRE)) {
+			pthread_cond_timedwait(&w->cnd, &w->mtx, ts);
+		}
+		__atomic_store_n(&w->zzz, 0, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&w->mtx);
+	}
+	return NULL;
+}
+
+static void
+wrk_wake(oqe_wrk_t w)
+{
+	if (__atomic_load_n(&w->zzz, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&w->mtx);
+		pthread_cond_signal(&w->cnd);
+		pthread_mutex_unlock(&w->mtx);
+	}
+	return;
+}
+
+static void
+fini_wrk(oqe_wrk_t w)
+{
+	for (size_t i = 0U; i < w->zbk; i++) {
+		if (w->bk[i].q != NULL) {
+			free_oq(w->bk[i].q);
+		}
+	}
+	free(w->bk);
+	fini_ring(w->in);
+	fini_ring(w->out);
+	fini_ring(w->ack);
+	pthread_mutex_destroy(&w->mtx);
+	pthread_cond_destroy(&w->cnd);
+	return;
+}
+
+static inline oqe_wrk_t
+route(oqe_t e, insid_t ins)
+{
+	return e->wrk + ins % e->nwrk;
+}
+
+
+/* public API */
+oqe_t
+make_oqe(size_t nwrk, insid_t fund_id)
+{
+	oqe_t res;
+	size_t i;
+
+	if (nwrk == 0U) {
+		return NULL;
+	} else if ((res = calloc(
+			    1, sizeof(*res) + nwrk * sizeof(*res->wrk))) == NULL) {
+		return NULL;
+	}
+	res->funid = fund_id;
+	for (i = 0U; i < nwrk; i++) {
+		oqe_wrk_t w = res->wrk + i;
+
+		w->e = res;
+		w->idx = i;
+		pthread_mutex_init(&w->mtx, NULL);
+		pthread_cond_init(&w->cnd, NULL);
+		if (init_ring(w->in, sizeof(struct oqe_msg_s)) < 0 ||
+		    init_ring(w->out, sizeof(struct umm_s)) < 0 ||
+		    init_ring(w->ack, sizeof(struct oqe_ack_s)) < 0) {
+			goto fail;
+		} else if (pthread_create(&w->thr, NULL, wrk, w) != 0) {
+			goto fail;
+		}
+		res->nwrk++;
+	}
+	return res;
+
+fail:
+	/* I is the worker whose set-up failed */
+	fini_ring(res->wrk[i].in);
+	fini_ring(res->wrk[i].out);
+	fini_ring(res->wrk[i].ack);
+	pthread_mutex_destroy(&res->wrk[i].mtx);
+	pthread_cond_destroy(&res->wrk[i].cnd);
+	free_oqe(res);
+	return NULL;
+}
+
+void
+free_oqe(oqe_t e)
+{
+	for (size_t i = 0U; i < e->nwrk; i++) {
+		oqe_wrk_t w = e->wrk + i;
+
+		/* let the worker drain its queue and quit */
+		pthread_mutex_lock(&w->mtx);
+		__atomic_store_n(&w->quit, true, __ATOMIC_RELEASE);
+		pthread_cond_signal(&w->cnd);
+		pthread_mutex_unlock(&w->mtx);
+		pthread_join(w->thr, NULL);
+		fini_wrk(w);
+	}
+	free(e);
+	return;
+}
+
+int
+oqe_add_order(oqe_t e, const struct umo_s *o, uint64_t ref)
+{
+	oqe_wrk_t w = route(e, o->instr_id);
+	struct oqe_msg_s m = {.op = OQE_ADD, .ref = ref, .o = *o};
+
+	if (UNLIKELY(ring_put(w->in, &m) < 0)) {
+		return -1;
+	}
+	wrk_wake(w);
+	return 0;
+}
+
+int
+oqe_cancel_order(oqe_t e, insid_t ins, oid_t oid, uint64_t ref)
+{
+	oqe_wrk_t w = route(e, ins);
+	struct oqe_msg_s m = {
+		.op = OQE_CANCEL, .oid = oid, .ref = ref, .o.instr_id = ins,
+	};
+
+	if (UNLIKELY(ring_put(w->in, &m) < 0)) {
+		return -1;
+	}
+	wrk_wake(w);
+	return 0;
+}
+
+size_t
+oqe_matches(oqe_t e, struct umm_s *ms, size_t n)
+{
+	size_t res = 0U;
+
+	for (size_t i = 0U; i < e->nwrk && res < n; i++) {
+		oqe_wrk_t w = e->wrk + (e->rr + i) % e->nwrk;
+
+		res += ring_get(w->out, ms + res, n - res);
+	}
+	/* start with somebody else next time */
+	e->rr++;
+	return res;
+}
+
+size_t
+oqe_acks(oqe_t e, struct oqe_ack_s *as, size_t n)
+{
+	size_t res = 0U;
+
+	for (size_t i = 0U; i < e->nwrk && res < n; i++) {
+		oqe_wrk_t w = e->wrk + (e->arr + i) % e->nwrk;
+
+		res += ring_get(w->ack, as + res, n - res);
+	}
+	/* start with somebody else next time */
+	e->arr++;
+	return res;
+}
+
+/* oq-eng.c ends here */
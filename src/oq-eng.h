@@ -0,0 +1,99 @@
+/*** oq-eng.h -- order queues of many instruments, sharded over threads
+ *
+ * Copyright (C) 2012-2013 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of unsermarkt.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_oq_eng_h_
+#define INCLUDED_oq_eng_h_
+
+#include <stddef.h>
+#include "oq.h"
+
+typedef struct oqe_s *oqe_t;
+
+/* acknowledgement of an order or cancellation submitted under REF */
+struct oqe_ack_s {
+	uint64_t ref;
+	insid_t ins;
+	/* the order id assigned to the order, which is what its matches
+	 * refer to, 0 if it was killed, or the order id of the cancelled
+	 * order */
+	oid_t oid;
+	/* status after the operation, OSTATUS_UNK for orders that didn't
+	 * rest (matched completely or killed, see the matches),
+	 * OSTATUS_REJ if the operation failed */
+	umost_t st;
+};
+
+/**
+ * Create an engine with NWRK worker threads, each of which owns the
+ * order queues (one per instrument, created on first sight) of the
+ * instruments routed to it, FUND_ID is used as funding id throughout.
+ * Workers are pinned to cores round-robin. */
+extern oqe_t make_oqe(size_t nwrk, insid_t fund_id);
+
+/**
+ * Drain all pending orders, stop the workers and free everything.
+ * Matches and acks not fetched by then are lost. */
+extern void free_oqe(oqe_t);
+
+/**
+ * Route order O to the worker owning O's instrument.
+ * The order id is handed back in an ack (see oqe_acks()) under REF.
+ * All submissions must come from the same thread.
+ * Return 0 on success or -1 if the worker's queue is full. */
+extern int oqe_add_order(oqe_t, const struct umo_s *o, uint64_t ref);
+
+/**
+ * Route the cancellation of order OID of instrument INS,
+ * the outcome is acked under REF. */
+extern int oqe_cancel_order(oqe_t, insid_t ins, oid_t oid, uint64_t ref);
+
+/**
+ * Fetch up to N matches, from all workers, into MS.
+ * Matches of any one instrument come in the order they occurred.
+ * Workers block while their match queues are full, so this must be
+ * called regularly, from one thread only.
+ * Return the number of matches fetched. */
+extern size_t oqe_matches(oqe_t, struct umm_s *ms, size_t n);
+
+/**
+ * Fetch up to N acks, from all workers, into AS.
+ * Acks of any one instrument come in the order of submission, an
+ * order's ack comes after the matches it caused.
+ * Like oqe_matches() this must be called regularly, from one thread.
+ * Return the number of acks fetched. */
+extern size_t oqe_acks(oqe_t, struct oqe_ack_s *as, size_t n);
+
+#endif	/* INCLUDED_oq_eng_h_ */
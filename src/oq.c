@@ -5,6 +5,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <errno.h>
 /* rudi's favourite */
 #include <assert.h>
 //#include <stdio.h>
@@ -20,6 +23,10 @@
 #include "oq.h"
 
 #define INITIAL_NUMOQ	(1024)
+/* initial capacity of the match ring, must be a power of 2 */
+#define INITIAL_NUMOM	(4096U)
+/* journal records staged before they're written */
+#define JRNL_NREC	(64U)
 
 #if !defined LIKELY
 # define LIKELY(_x)	__builtin_expect((_x), 1)
@@ -38,29 +45,22 @@
  * Helper structure to store a bit more than just the umo order. */
 typedef struct umoq_o_s *umoq_o_t;
 
-/**
- * Matching cache.  This is to give the settlement module a more succinct
- * list of events. */
-typedef struct umoq_m_s *umoq_m_t;
-
 /**
  * Helper structure around an uml_s level struct. */
 typedef struct umoq_l_s *umoq_l_t;
 
-struct umoq_m_s {
-	umoq_m_t next;
-	umoq_m_t prev;
-	struct umm_s m[1];
-};
-
-/* like order_s but has status and oid slots and can be chained through NEXT */
+/* like order_s but has status and oid slots and can be chained through NEXT
+ * and PREV */
 struct umoq_o_s {
 	umoq_o_t next;
+	umoq_o_t prev;
 	struct umo_s o[1];
 	uint32_t oid;
 	umost_t st;
 	/* up pointer to the level structure */
 	umoq_l_t lev;
+	/* slot in the trigger heap, for dormant stop and MIT orders */
+	uint32_t hix;
 };
 
 /* helper structure to chain uml_s levels together */
@@ -71,6 +71,18 @@ struct umoq_l_s {
 	 * first umoq_o cell at the given price level but to the
 	 * last cell of the previous price level. */
 	umoq_o_t ord;
+	/* slot in the market data update buffer, valid if UBAT matches */
+	uint32_t uix;
+	uint32_t ubat;
+};
+
+/* binary heap of dormant orders, keyed by trigger price then order id */
+struct umoq_h_s {
+	umoq_o_t *c;
+	size_t n;
+	size_t z;
+	/* lowest trigger price on top if set, highest otherwise */
+	bool up;
 };
 
 /* the overall pointer structure is liek this:
@@ -94,9 +106,17 @@ struct umoq_s {
 	struct umoq_o_s oa[1];
 	/* suspended orders */
 	struct umoq_o_s os[1];
+	/* orders waiting for an auction, most recent first */
+	struct umoq_o_s oo[1];
 	/* order id counter, should be global */
 	uint32_t oid;
 
+	/* dense order id index, slot I holds the cell of order OIXB + I,
+	 * or NULL if that order isn't on the books (anymore) */
+	umoq_o_t *oix;
+	size_t noix;
+	oid_t oixb;
+
 	/* level slots, accum'd,
 	 * levels are guarded by lb[0] and lb[1] or
 	 * la[0] and la[1] respectively
@@ -104,9 +124,38 @@ struct umoq_s {
 	struct umoq_l_s lb[2];
 	struct umoq_l_s la[2];
 
-	/* matching queue */
-	mmls_t mls;
-	struct umoq_m_s ms[2];
+	/* optional price ladder, slot I holds the level at price
+	 * TLO + I * TICK (or NULL), bit I in TBB/TBA is set iff slot I
+	 * of TLB/TLA is occupied, levels off the ladder (out of range or
+	 * off tick) are still found by walking the level chain */
+	int32_t tlo;
+	int32_t tick;
+	size_t nt;
+	umoq_l_t *tlb;
+	umoq_l_t *tla;
+	uint64_t *tbb;
+	uint64_t *tba;
+
+	/* dormant stop and MIT orders, TUP fires when the last trade is
+	 * at or above the trigger price, TDN when at or below */
+	struct umoq_h_s tup[1];
+	struct umoq_h_s tdn[1];
+	/* last traded price, if TRDP */
+	m30_t last;
+	bool trdp;
+	/* order id of the aggressor, if it has one already */
+	oid_t aoid;
+
+	/* match ring, match number S lives in slot S % MRZ, MHD is the
+	 * number of the next match, matches from MTL on are held for
+	 * traversal, those from MSRV on haven't been served yet,
+	 * older ones (up to MRZ back) can still be read by cursor */
+	struct umm_s *mr;
+	size_t mrz;
+	uint64_t mhd;
+	uint64_t mtl;
+	uint64_t msrv;
+	size_t mhiw;
 
 	/* security id and funding id */
 	insid_t secid;
@@ -115,29 +164,33 @@ struct umoq_s {
 	/* match callback, other cbs could be order status changes */
 	void(*match_cb)(umm_t, void*);
 	void *match_clo;
+	/* batch flavour, matches are handed over in one array */
+	void(*matches_cb)(const struct umm_s*, size_t, void*);
+	void *matches_clo;
+	struct umm_s *mbuf;
+	size_t mbsz;
+
+	/* market data, level updates since they've last been served,
+	 * UBAT counts the servings, TOB is the top of book last served */
+	void(*l2_cb)(const struct oq_l2u_s*, size_t, void*);
+	void *l2_clo;
+	struct oq_l2u_s *ub;
+	size_t nub;
+	size_t zub;
+	uint32_t ubat;
+	struct uml_s tob[2];
+
+	/* journal, -1 if none, and the event sequence number which
+	 * advances whether or not there's a journal */
+	int jfd;
+	bool jon;
+	uint32_t jseq;
+	size_t njr;
+	struct oq_jrec_s jr[JRNL_NREC];
 };
 
 
 /* helper functions */
-static umoq_o_t
-best_ask(umoq_t q)
-{
-	return q->oa->next;
-}
-
-static umoq_o_t
-best_bid(umoq_t q)
-{
-	return q->ob->next;
-}
-
-static umoq_o_t
-susp_head(umoq_t q)
-{
-/* return the pointer to the first suspended order */
-	return q->os->next;
-}
-
 static umoq_o_t
 pop_o(umoq_t q)
 {
@@ -168,34 +221,165 @@ push_l(umoq_t q, umoq_l_t l)
 	return;
 }
 
-static umoq_m_t
-pop_m(umoq_t q)
+static umm_t
+put_m(umoq_t q)
 {
-	umoq_m_t res = mmls_pop_cell(q->mls);
+/* return the slot for the next match, unserved matches are never
+ * overwritten, the ring grows instead */
+	umm_t res;
+
+	if (UNLIKELY(q->mhd - q->msrv >= q->mrz)) {
+		size_t nu = q->mrz * 2U;
+		struct umm_s *tmp;
+
+		if ((tmp = malloc(nu * sizeof(*tmp))) == NULL) {
+			/* overwrite the oldest then */
+			q->msrv++;
+		} else {
+			for (uint64_t s = q->mhd - q->mrz; s < q->mhd; s++) {
+				tmp[s & (nu - 1U)] = q->mr[s & (q->mrz - 1U)];
+			}
+			free(q->mr);
+			q->mr = tmp;
+			q->mrz = nu;
+		}
+	}
+	if (q->mhd - q->mtl >= q->mrz) {
+		/* oldest held match falls off */
+		q->mtl++;
+	}
+	res = q->mr + (q->mhd++ & (q->mrz - 1U));
+	memset(res, 0, sizeof(*res));
+	if (q->mhd - q->mtl > q->mhiw) {
+		q->mhiw = q->mhd - q->mtl;
+	}
 	return res;
 }
 
+static inline umm_t
+get_m(umoq_t q, uint64_t s)
+{
+	return q->mr + (s & (q->mrz - 1U));
+}
+
+
+static size_t
+lad_slot(umoq_t q, m30_t p)
+{
+/* return ladder slot of price P or Q->NT if not on the ladder */
+	int64_t d = (int64_t)p.v - q->tlo;
+
+	if (d < 0 || q->nt == 0U || d % q->tick) {
+		return q->nt;
+	} else if ((size_t)(d /= q->tick) >= q->nt) {
+		return q->nt;
+	}
+	return (size_t)d;
+}
+
+static size_t
+lad_next(const uint64_t *b, size_t n, size_t i)
+{
+/* lowest occupied slot above I, or N */
+	size_t w;
+	uint64_t x;
+
+	if (++i >= n) {
+		return n;
+	}
+	w = i / 64U;
+	for (x = b[w] & (~0ULL << (i % 64U)); !x; x = b[w]) {
+		if (++w >= (n + 63U) / 64U) {
+			return n;
+		}
+	}
+	return w * 64U + __builtin_ctzll(x);
+}
+
+static size_t
+lad_prev(const uint64_t *b, size_t n, size_t i)
+{
+/* highest occupied slot below I, or N */
+	size_t w;
+	uint64_t x;
+
+	if (i-- == 0U) {
+		return n;
+	}
+	w = i / 64U;
+	for (x = b[w] & (~0ULL >> (63U - i % 64U)); !x; x = b[w]) {
+		if (w-- == 0U) {
+			return n;
+		}
+	}
+	return w * 64U + 63U - __builtin_clzll(x);
+}
+
 static void
-push_m(umoq_t q, umoq_m_t m)
+lad_put(umoq_l_t *t, uint64_t *b, size_t i, umoq_l_t l)
 {
-	m->next = (void*)0xdeadbeef;
-	mmls_push_cell(q->mls, m);
+	if ((t[i] = l) != NULL) {
+		b[i / 64U] |= 1ULL << (i % 64U);
+	} else {
+		b[i / 64U] &= ~(1ULL << (i % 64U));
+	}
 	return;
 }
 
-
 static umoq_l_t
 ins_new_level_after(umoq_t q, umoq_l_t l, m30_t p)
 {
-	umoq_l_t new = pop_l(q);
+	umoq_l_t new;
+
+	if (UNLIKELY((new = pop_l(q)) == NULL)) {
+		return NULL;
+	}
 	/* insert after l */
 	new->next = l->next, l->next = new;
 	new->l->p = p;
 	new->l->q = 0;
 	new->ord = new->next->ord;
+	new->ubat = 0U;
 	return new;
 }
 
+static int
+l2_grow(umoq_t q)
+{
+	size_t nu = q->zub ? q->zub * 2U : 64U;
+	struct oq_l2u_s *tmp;
+
+	if ((tmp = realloc(q->ub, nu * sizeof(*tmp))) == NULL) {
+		return -1;
+	}
+	q->ub = tmp;
+	q->zub = nu;
+	return 0;
+}
+
+static void
+l2_mark(umoq_t q, umoq_l_t l, oside_t side)
+{
+/* L's quantity has changed, remember it for the feed */
+	if (q->l2_cb == NULL) {
+		return;
+	} else if (l->ubat == q->ubat) {
+		/* changed before, just update */
+		q->ub[l->uix].q = l->l->q;
+		return;
+	} else if (UNLIKELY(q->nub >= q->zub) && l2_grow(q) < 0) {
+		return;
+	}
+	l->uix = (uint32_t)q->nub;
+	l->ubat = q->ubat;
+	q->ub[q->nub++] = (struct oq_l2u_s){
+		.side = side,
+		.p = l->l->p,
+		.q = l->l->q,
+	};
+	return;
+}
+
 static umoq_l_t
 rem_order_from_level(umoq_t q, umoq_o_t io)
 {
@@ -203,77 +387,315 @@ rem_order_from_level(umoq_t q, umoq_o_t io)
 
 	assert(il->l->p.v == io->o->p.v);
 	assert(il->l->q >= io->o->q);
-	if ((il->l->q -= io->o->q) == 0) {
+	il->l->q -= io->o->q;
+	l2_mark(q, il, um_order_side(io->o));
+	if (il->l->q == 0) {
 		umoq_l_t prev = il->ord->lev;
+		size_t i;
+
 		/* discard the whole level? */
 		prev->next = il->next;
 		il->next->ord = il->ord;
+		if ((i = lad_slot(q, il->l->p)) < q->nt) {
+			if (um_order_side(io->o) == OSIDE_BUY) {
+				lad_put(q->tlb, q->tbb, i, NULL);
+			} else {
+				lad_put(q->tla, q->tba, i, NULL);
+			}
+		}
 		push_l(q, il);
 	}
 	return il;
 }
 
-static umoq_o_t
-find_by_side_by_oid(umoq_o_t s, oid_t oid)
+static void
+unlink_o(umoq_t q, umoq_o_t io)
 {
-	for (; s; s = s->next) {
-		if (s->oid == oid) {
-			return s;
+/* take IO out of its chain and, if it's on the books, out of its level */
+	umoq_l_t il = io->lev;
+
+	io->prev->next = io->next;
+	if (io->next != NULL) {
+		io->next->prev = io->prev;
+	}
+	if (il != NULL) {
+		/* IO might have been the last cell of its level */
+		if (il->next->ord == io) {
+			il->next->ord = io->prev;
 		}
+		rem_order_from_level(q, io);
 	}
-	return NULL;
+	io->next = io->prev = NULL;
+	return;
 }
 
 static umoq_o_t
 find_by_oid(umoq_t q, oid_t oid)
 {
-	umoq_o_t res;
-	/* try and find it in the bids, then asks, then suspended orders */
-	if ((res = find_by_side_by_oid(best_bid(q), oid)) != NULL) {
-		return res;
-	} else if ((res = find_by_side_by_oid(best_ask(q), oid)) != NULL) {
-		return res;
-	} else if ((res = find_by_side_by_oid(susp_head(q), oid)) != NULL) {
-		return res;
+	if (UNLIKELY(oid < q->oixb || oid - q->oixb >= q->noix)) {
+		return NULL;
 	}
-	return NULL;
+	return q->oix[oid - q->oixb];
 }
 
-static umoq_o_t
-rem_by_side_by_oid(umoq_o_t s, oid_t oid)
+static int
+oix_put(umoq_t q, umoq_o_t io)
+{
+/* index IO by its oid, return -1 if the index can't grow,
+ * IO stays unindexed then */
+	size_t i;
+
+	if (UNLIKELY(io->oid < q->oixb)) {
+		/* rebase, only when orders come in out of sequence */
+		size_t k = q->oixb - io->oid;
+		size_t nu = q->noix + k;
+		umoq_o_t *tmp;
+
+		if ((tmp = realloc(q->oix, nu * sizeof(*tmp))) == NULL) {
+			return -1;
+		}
+		memmove(tmp + k, tmp, q->noix * sizeof(*tmp));
+		memset(tmp, 0, k * sizeof(*tmp));
+		q->oix = tmp;
+		q->noix = nu;
+		q->oixb = io->oid;
+	}
+	if (UNLIKELY((i = io->oid - q->oixb) >= q->noix)) {
+		/* drop leading slots of orders gone already */
+		size_t k;
+
+		for (k = 0; k < q->noix && q->oix[k] == NULL; k++);
+		if (k > 0U) {
+			memmove(q->oix, q->oix + k, (q->noix - k) * sizeof(*q->oix));
+			memset(q->oix + q->noix - k, 0, k * sizeof(*q->oix));
+			q->oixb += k;
+			i -= k;
+		}
+		if (i >= q->noix / 2U) {
+			/* still crowded */
+			size_t nu = q->noix ? q->noix * 2U : INITIAL_NUMOQ;
+
+			umoq_o_t *tmp;
+
+			while (nu <= i) {
+				nu *= 2U;
+			}
+			if ((tmp = realloc(q->oix, nu * sizeof(*tmp))) == NULL) {
+				return -1;
+			}
+			memset(tmp + q->noix, 0, (nu - q->noix) * sizeof(*tmp));
+			q->oix = tmp;
+			q->noix = nu;
+		}
+	}
+	q->oix[i] = io;
+	return 0;
+}
+
+static void
+oix_del(umoq_t q, oid_t oid)
+{
+	if (LIKELY(oid >= q->oixb && oid - q->oixb < q->noix)) {
+		q->oix[oid - q->oixb] = NULL;
+	}
+	return;
+}
+
+static inline bool
+heap_before(const struct umoq_h_s *h, umoq_o_t a, umoq_o_t b)
+{
+/* whether A fires before B */
+	if (a->o->p.v != b->o->p.v) {
+		return h->up ? a->o->p.v < b->o->p.v : a->o->p.v > b->o->p.v;
+	}
+	return a->oid < b->oid;
+}
+
+static inline void
+heap_set(struct umoq_h_s *h, size_t i, umoq_o_t io)
+{
+	h->c[i] = io;
+	io->hix = (uint32_t)i;
+	return;
+}
+
+static void
+heap_up(struct umoq_h_s *h, size_t i)
+{
+	umoq_o_t io = h->c[i];
+
+	while (i > 0U) {
+		size_t p = (i - 1U) / 2U;
+
+		if (!heap_before(h, io, h->c[p])) {
+			break;
+		}
+		heap_set(h, i, h->c[p]);
+		i = p;
+	}
+	heap_set(h, i, io);
+	return;
+}
+
+static void
+heap_down(struct umoq_h_s *h, size_t i)
 {
-/* remove the order with the order id OID and return it's umoq_o cell
- * Note: we require S to have a guard pointer at the beginning,
- * so S itself cannot be subject to deletion. */
-	for (; s->next; s = s->next) {
-		if (s->next->oid == oid) {
-			umoq_o_t res = s->next;
-			s->next = s->next->next, res->next = NULL;
-			return res;
+	umoq_o_t io = h->c[i];
+
+	for (size_t c; (c = 2U * i + 1U) < h->n; i = c) {
+		if (c + 1U < h->n && heap_before(h, h->c[c + 1U], h->c[c])) {
+			c++;
 		}
+		if (!heap_before(h, h->c[c], io)) {
+			break;
+		}
+		heap_set(h, i, h->c[c]);
 	}
-	return NULL;
+	heap_set(h, i, io);
+	return;
+}
+
+static int
+heap_put(struct umoq_h_s *h, umoq_o_t io)
+{
+	if (UNLIKELY(h->n >= h->z)) {
+		size_t nu = h->z ? h->z * 2U : 64U;
+		umoq_o_t *tmp;
+
+		if ((tmp = realloc(h->c, nu * sizeof(*tmp))) == NULL) {
+			return -1;
+		}
+		h->c = tmp;
+		h->z = nu;
+	}
+	heap_set(h, h->n++, io);
+	heap_up(h, io->hix);
+	return 0;
+}
+
+static void
+heap_del(struct umoq_h_s *h, size_t i)
+{
+	umoq_o_t last = h->c[--h->n];
+
+	if (i < h->n) {
+		heap_set(h, i, last);
+		heap_up(h, i);
+		heap_down(h, last->hix);
+	}
+	return;
+}
+
+static struct umoq_h_s*
+trig_heap(umoq_t q, umo_t o)
+{
+/* buy stops and sell MITs fire on the way up */
+	if ((o->tymod == OTYMOD_STOP) == (um_order_side(o) == OSIDE_BUY)) {
+		return q->tup;
+	}
+	return q->tdn;
 }
 
 static umoq_o_t
 rem_by_oid(umoq_t q, oid_t oid)
 {
-/* like find_by_oid but returns the predecessor */
+/* like find_by_oid but takes the order off the books */
 	umoq_o_t res;
 
-	if ((res = rem_by_side_by_oid(q->ob, oid)) != NULL) {
-		/* update the corresponding level */
-		rem_order_from_level(q, res);
-		return res;
-	} else if ((res = rem_by_side_by_oid(q->oa, oid)) != NULL) {
-		/* update the corresponding level */
-		rem_order_from_level(q, res);
-		return res;
-	} else if ((res = rem_by_side_by_oid(q->os, oid)) != NULL) {
-		/* no level to update here */
-		return res;
+	if ((res = find_by_oid(q, oid)) == NULL) {
+		;
+	} else if (res->prev == NULL) {
+		/* dormant, chained in neither direction */
+		heap_del(trig_heap(q, res->o), res->hix);
+		oix_del(q, oid);
+	} else {
+		/* unlink and update the corresponding level, if any */
+		unlink_o(q, res);
+		oix_del(q, oid);
+	}
+	return res;
+}
+
+static ssize_t
+xwrite(int fd, const void *buf, size_t bsz)
+{
+	size_t tot = 0U;
+
+	while (tot < bsz) {
+		ssize_t nwr = write(fd, (const char*)buf + tot, bsz - tot);
+
+		if (nwr < 0 && errno == EINTR) {
+			continue;
+		} else if (nwr <= 0) {
+			return -1;
+		}
+		tot += nwr;
+	}
+	return tot;
+}
+
+static ssize_t
+xread(int fd, void *buf, size_t bsz)
+{
+/* read BSZ bytes unless there's an eof */
+	size_t tot = 0U;
+
+	while (tot < bsz) {
+		ssize_t nrd = read(fd, (char*)buf + tot, bsz - tot);
+
+		if (nrd < 0 && errno == EINTR) {
+			continue;
+		} else if (nrd < 0) {
+			return -1;
+		} else if (nrd == 0) {
+			break;
+		}
+		tot += nrd;
+	}
+	return tot;
+}
+
+static void
+jrnl_flush(umoq_t q)
+{
+	if (q->njr == 0U) {
+		return;
+	} else if (xwrite(q->jfd, q->jr, q->njr * sizeof(*q->jr)) < 0) {
+		/* stop journalling, oq_set_journal() will tell */
+		q->jfd = -1;
 	}
-	return NULL;
+	q->njr = 0U;
+	return;
+}
+
+static void
+jrnl_rec(umoq_t q, oq_jev_t ev, oid_t oid, const void *p, size_t z)
+{
+	struct oq_jrec_s *r;
+
+	if (q->jfd < 0) {
+		return;
+	} else if (q->njr >= JRNL_NREC) {
+		jrnl_flush(q);
+	}
+	r = q->jr + q->njr++;
+	memset(r, 0, sizeof(*r));
+	r->seq = q->jseq;
+	r->ev = ev;
+	r->oid = oid;
+	if (p != NULL) {
+		memcpy(&r->o, p, z);
+	}
+	return;
+}
+
+static void
+jrnl_ev(umoq_t q, oq_jev_t ev, oid_t oid, umo_t o)
+{
+/* record an event that changes the books */
+	q->jseq++;
+	jrnl_rec(q, ev, oid, o, sizeof(*o));
+	return;
 }
 
 static umoq_l_t
@@ -281,10 +703,21 @@ bid_side_level(umoq_t q, m30_t p)
 {
 /* returns the cons cell that has a better price than L, or NULL if
  * it's the best price */
-	umoq_l_t l;
+	umoq_l_t l = q->lb;
+	size_t i;
+
+	if ((i = lad_slot(q, p)) < q->nt) {
+		size_t j;
 
+		if (q->tlb[i] != NULL) {
+			return q->tlb[i];
+		} else if ((j = lad_next(q->tbb, q->nt, i)) < q->nt) {
+			/* start off at the next better level */
+			l = q->tlb[j];
+		}
+	}
 	/* look for a suitable cons cell */
-	for (l = q->lb; l->next != q->lb + 1; l = l->next) {
+	for (; l->next != q->lb + 1; l = l->next) {
 		m30_t pp = l->next->l->p;
 		if (pp.v == p.v) {
 			return l->next;
@@ -293,7 +726,11 @@ bid_side_level(umoq_t q, m30_t p)
 		}
 	}
 	/*  the price level not existant, create one */
-	return ins_new_level_after(q, l, p);
+	l = ins_new_level_after(q, l, p);
+	if (l != NULL && i < q->nt) {
+		lad_put(q->tlb, q->tbb, i, l);
+	}
+	return l;
 }
 
 static umoq_l_t
@@ -301,10 +738,21 @@ ask_side_level(umoq_t q, m30_t p)
 {
 /* returns the cons cell that has a better price than L, or NULL if
  * it's the best price */
-	umoq_l_t l;
+	umoq_l_t l = q->la;
+	size_t i;
+
+	if ((i = lad_slot(q, p)) < q->nt) {
+		size_t j;
 
+		if (q->tla[i] != NULL) {
+			return q->tla[i];
+		} else if ((j = lad_prev(q->tba, q->nt, i)) < q->nt) {
+			/* start off at the next better level */
+			l = q->tla[j];
+		}
+	}
 	/* look for a suitable cons cell */
-	for (l = q->la; l->next != q->la + 1; l = l->next) {
+	for (; l->next != q->la + 1; l = l->next) {
 		m30_t pp = l->next->l->p;
 		if (pp.v == p.v) {
 			return l->next;
@@ -313,7 +761,11 @@ ask_side_level(umoq_t q, m30_t p)
 		}
 	}
 	/*  the price level not existant, create one */
-	return ins_new_level_after(q, l, p);
+	l = ins_new_level_after(q, l, p);
+	if (l != NULL && i < q->nt) {
+		lad_put(q->tla, q->tba, i, l);
+	}
+	return l;
 }
 
 static int
@@ -326,12 +778,9 @@ add_order(umoq_t q, umoq_o_t io)
 	switch (um_order_side(io->o)) {
 	case OSIDE_BUY:
 		lev = bid_side_level(q, io->o->p);
-		/* when there's a level there should be a slot */
-		prev = lev->next->ord;
 		break;
 	case OSIDE_SELL:
 		lev = ask_side_level(q, io->o->p);
-		prev = lev->next->ord;
 		break;
 	case OSIDE_UNK:
 	case NOSIDES:
@@ -339,47 +788,47 @@ add_order(umoq_t q, umoq_o_t io)
 		return -1;
 	}
 
-	assert(lev != NULL);
+	if (UNLIKELY(lev == NULL)) {
+		/* no more level cells */
+		return -1;
+	}
+	/* when there's a level there should be a slot */
+	prev = lev->next->ord;
 	/* fiddle with prev, insert o after prev */
 	io->next = prev->next, prev->next = io;
+	io->prev = prev;
+	if (io->next != NULL) {
+		io->next->prev = io;
+	}
 	lev->l->q += io->o->q;
+	l2_mark(q, lev, um_order_side(io->o));
 	io->lev = lev;
 	/* update the level pointer */
 	lev->next->ord = io;
 	return 0;
 }
 
-static int
-add_match(umoq_t q, umoq_m_t im)
-{
-	/* insert into our list */
-	im->next = q->ms->next, q->ms->next = im;
-	im->next->prev = im;
-	im->prev = q->ms;
-	return 0;
-}
-
-static umoq_m_t
+static umm_t
 add_match_immediate_pfill(umoq_t q, umoq_o_t qo, umo_t new_o)
 {
 /* assume the counterparty has the same quantity and no order id yet */
-	umoq_m_t im = pop_m(q);
+	umm_t m = put_m(q);
 
 	/* sort of inverts the meaning */
 	switch (um_order_side(qo->o)) {
 	case OSIDE_BUY:
-		im->m->ob = qo->oid;
-		im->m->os = ++q->oid;
+		m->ob = qo->oid;
+		m->os = q->aoid ? q->aoid : ++q->oid;
 		/* agent tracking */
-		im->m->ab = qo->o->agent_id;
-		im->m->as = new_o->agent_id;
+		m->ab = qo->o->agent_id;
+		m->as = new_o->agent_id;
 		break;
 	case OSIDE_SELL:
-		im->m->ob = ++q->oid;
-		im->m->os = qo->oid;
+		m->ob = q->aoid ? q->aoid : ++q->oid;
+		m->os = qo->oid;
 		/* agent tracking */
-		im->m->ab = new_o->agent_id;
-		im->m->as = qo->o->agent_id;
+		m->ab = new_o->agent_id;
+		m->as = qo->o->agent_id;
 		break;
 	case OSIDE_UNK:
 	case NOSIDES:
@@ -387,17 +836,19 @@ add_match_immediate_pfill(umoq_t q, umoq_o_t qo, umo_t new_o)
 		abort();
 	}
 	/* make sure we keep track of the instruments traded */
-	im->m->ib = q->secid;
-	im->m->is = q->funid;
+	m->ib = q->secid;
+	m->is = q->funid;
 	/* stipulate the price and quantity here */
-	im->m->p = qo->o->p;
-	im->m->q = new_o->q;
-	/* insert into our list */
-	add_match(q, im);
-	return im;
+	m->p = qo->o->p;
+	m->q = new_o->q;
+	/* for the stops and MITs */
+	q->last = qo->o->p;
+	q->trdp = true;
+	jrnl_rec(q, OQ_JEV_MATCH, 0U, m, sizeof(*m));
+	return m;
 }
 
-static umoq_m_t
+static umm_t
 add_match_immediate(umoq_t q, umoq_o_t o, umo_t new_o)
 {
 /* assume the counterparty has the same quantity and no order id yet */
@@ -454,7 +905,10 @@ match_order(umoq_t q, umo_t o)
 	}
 
 	/* if it's a market-to-limit order, get the current market price */
-	if (um_order_type(o) == OTYPE_MTL) {
+	if (um_order_type(o) == OTYPE_MTL && sta->next == NULL) {
+		/* no market, no price */
+		return NULL;
+	} else if (um_order_type(o) == OTYPE_MTL) {
 		/* set the top level ask as limit */
 		o->p = sta->next->o->p;
 	}
@@ -466,15 +920,12 @@ match_order(umoq_t q, umo_t o)
 		/* retune the quantity cell */
 		o->q -= fro->o->q;
 
-		/* adapt o's level as well */
-		rem_order_from_level(q, fro);
-
 		/* record the matches */
 		add_match_immediate(q, fro, o);
 
-		/* we can make a match, but we'd have to fiddle
-		 * with the queue */
-		sta->next = sta->next->next;
+		/* take it off the books, level and all */
+		unlink_o(q, fro);
+		oix_del(q, fro->oid);
 
 		/* what happens to all the freed cells here? :O */
 		push_o(q, fro);
@@ -496,31 +947,139 @@ match_order(umoq_t q, umo_t o)
 		assert(sta->lev->next->l->q > o->q);
 		/* adapt the levels as well */
 		sta->lev->next->l->q -= o->q;
+		l2_mark(q, sta->lev->next, um_order_side(sta->next->o));
 		/* total fill */
 		o->q = 0;
 		return NULL;
 	}
 
 	/* put the rest on the queue as limit */
-	sta = pop_o(q);
+	if (UNLIKELY((sta = pop_o(q)) == NULL)) {
+		/* no more order cells, the rest is lost */
+		return NULL;
+	}
 	/* copy the order guts */
 	*sta->o = *o;
 	return sta;
 }
 
-static umoq_o_t
-try_match(umoq_t q, umo_t o)
+static int
+clr_matches(umoq_t q)
+{
+/* return the number of matches cleared */
+	int res = (int)(q->mhd - q->mtl);
+
+	q->mtl = q->mhd;
+	return res;
+}
+
+static size_t
+read_m(umoq_t q, uint64_t beg, struct umm_s *tgt, size_t n)
 {
-	umoq_o_t res = match_order(q, o);
-	/* if there's a callback for matches, serve it */
-	if (q->match_cb != NULL) {
-		for (umoq_m_t m = (q->ms + 1)->prev; m != q->ms; m = m->prev) {
-			q->match_cb(m->m, q->match_clo);
-			/* unlink the match, DO ME PROPERLY! */
-			m->prev->next = q->ms + 1;
+/* copy up to N matches from BEG on to TGT, BEG must still be there */
+	size_t i = beg & (q->mrz - 1U);
+	size_t n1;
+
+	if (n > q->mhd - beg) {
+		n = q->mhd - beg;
+	}
+	/* up to the end of the ring, then the wrapped part */
+	n1 = i + n <= q->mrz ? n : q->mrz - i;
+	memcpy(tgt, q->mr + i, n1 * sizeof(*tgt));
+	memcpy(tgt + n1, q->mr, (n - n1) * sizeof(*tgt));
+	return n;
+}
+
+static void
+serve_matches(umoq_t q)
+{
+/* if there's a callback for matches, serve it */
+	size_t nm = q->mhd - q->msrv;
+
+	if (nm == 0U) {
+		return;
+	} else if (q->matches_cb != NULL) {
+		size_t i = q->msrv & (q->mrz - 1U);
+
+		if (i + nm <= q->mrz) {
+			/* contiguous, hand out the ring itself */
+			q->matches_cb(q->mr + i, nm, q->matches_clo);
+		} else {
+			/* wrapped, stitch it together in MBUF */
+			if (nm > q->mbsz) {
+				free(q->mbuf);
+				q->mbuf = malloc(nm * sizeof(*q->mbuf));
+				q->mbsz = q->mbuf != NULL ? nm : 0U;
+			}
+			if (nm <= q->mbsz) {
+				read_m(q, q->msrv, q->mbuf, nm);
+				q->matches_cb(q->mbuf, nm, q->matches_clo);
+			} else {
+				/* no room to stitch, hand out both halves */
+				size_t n1 = q->mrz - i;
+
+				q->matches_cb(q->mr + i, n1, q->matches_clo);
+				q->matches_cb(q->mr, nm - n1, q->matches_clo);
+			}
+		}
+		/* served, done with them */
+		clr_matches(q);
+	} else if (q->match_cb != NULL) {
+		for (uint64_t s = q->msrv; s < q->mhd; s++) {
+			q->match_cb(get_m(q, s), q->match_clo);
 		}
+		/* served, done with them */
+		clr_matches(q);
 	}
-	return res;
+	q->msrv = q->mhd;
+	return;
+}
+
+static void
+l2_tob(umoq_t q, umoq_l_t l, umoq_l_t end, oside_t side)
+{
+/* append a top-of-book entry for SIDE if it's different from last time */
+	struct uml_s tob = l != end ? *l->l : (struct uml_s){0};
+	struct uml_s *old = q->tob + (side == OSIDE_SELL);
+
+	if (tob.p.u == old->p.u && tob.q == old->q) {
+		return;
+	} else if (UNLIKELY(q->nub >= q->zub)) {
+		/* no room, leave it for next time */
+		return;
+	}
+	q->ub[q->nub++] = (struct oq_l2u_s){
+		.side = side,
+		.tob = 1U,
+		.p = tob.p,
+		.q = tob.q,
+	};
+	*old = tob;
+	return;
+}
+
+static void
+l2_serve(umoq_t q)
+{
+/* hand level updates since the last serving to the feed callback */
+	if (q->l2_cb == NULL) {
+		return;
+	}
+	/* make sure there's room for the top of book */
+	if (UNLIKELY(q->nub + 2U > q->zub)) {
+		(void)l2_grow(q);
+	}
+	l2_tob(q, q->lb->next, q->lb + 1, OSIDE_BUY);
+	l2_tob(q, q->la->next, q->la + 1, OSIDE_SELL);
+	if (q->nub > 0U) {
+		q->l2_cb(q->ub, q->nub, q->l2_clo);
+	}
+	q->nub = 0U;
+	/* invalidate all slot indices at once, 0 is never used */
+	if (UNLIKELY(++q->ubat == 0U)) {
+		q->ubat++;
+	}
+	return;
 }
 
 
@@ -533,12 +1092,14 @@ make_oq(insid_t secu_id, insid_t fund_id)
 	/* wipe the order space */
 	memset(res->ob, 0, sizeof(*res->ob));
 	memset(res->oa, 0, sizeof(*res->oa));
+	memset(res->os, 0, sizeof(*res->os));
+	memset(res->oo, 0, sizeof(*res->oo));
 	/* wipe the level space */
 	memset(res->lb, 0, 2 * sizeof(*res->lb));
 	memset(res->la, 0, 2 * sizeof(*res->la));
 	/* now a more complex task */
 	res->ols = make_mmls(sizeof(struct umoq_o_s), INITIAL_NUMOQ);
-	res->lls = make_mmls(sizeof(struct umoq_o_s), INITIAL_NUMOQ);
+	res->lls = make_mmls(sizeof(struct umoq_l_s), INITIAL_NUMOQ);
 
 	/* set initial level pointers */
 	res->oa->lev = res->la;
@@ -553,12 +1114,27 @@ make_oq(insid_t secu_id, insid_t fund_id)
 
 	/* start with a fresh oid count */
 	res->oid = 0;
-
-	/* initialise the matching cache */
-	res->mls = make_mmls(sizeof(struct umoq_m_s), INITIAL_NUMOQ);
-	memset(res->ms, 0, 2 * sizeof(*res->ms));
-	res->ms[0].next = res->ms + 1;
-	res->ms[1].prev = res->ms + 0;
+	res->oix = NULL;
+	res->noix = 0U;
+	res->oixb = 1U;
+
+	/* no triggers, no trades */
+	memset(res->tup, 0, sizeof(*res->tup));
+	memset(res->tdn, 0, sizeof(*res->tdn));
+	res->tup->up = true;
+	res->trdp = false;
+	res->aoid = 0U;
+
+	/* no ladder yet */
+	res->nt = 0U;
+	res->tlb = res->tla = NULL;
+	res->tbb = res->tba = NULL;
+
+	/* initialise the match ring */
+	res->mr = malloc(INITIAL_NUMOM * sizeof(*res->mr));
+	res->mrz = INITIAL_NUMOM;
+	res->mhd = res->mtl = res->msrv = 0U;
+	res->mhiw = 0U;
 
 	/* finally keep track of what we are */
 	res->secid = secu_id;
@@ -567,36 +1143,236 @@ make_oq(insid_t secu_id, insid_t fund_id)
 	/* set match_cb and match_clo */
 	res->match_cb = NULL;
 	res->match_clo = NULL;
+	res->matches_cb = NULL;
+	res->matches_clo = NULL;
+	res->mbuf = NULL;
+	res->mbsz = 0U;
+
+	/* no market data feed */
+	res->l2_cb = NULL;
+	res->l2_clo = NULL;
+	res->ub = NULL;
+	res->nub = res->zub = 0U;
+	res->ubat = 1U;
+	memset(res->tob, 0, sizeof(res->tob));
+
+	/* no journal */
+	res->jfd = -1;
+	res->jon = false;
+	res->jseq = 0U;
+	res->njr = 0U;
 	return res;
 }
 
 void
 free_oq(umoq_t q)
 {
+	if (q->jfd >= 0) {
+		jrnl_flush(q);
+	}
 	free_mmls(q->ols);
 	free_mmls(q->lls);
-	free_mmls(q->mls);
+	free(q->mr);
+	if (q->ub != NULL) {
+		free(q->ub);
+	}
+	if (q->oix != NULL) {
+		free(q->oix);
+	}
+	if (q->mbuf != NULL) {
+		free(q->mbuf);
+	}
+	free(q->tup->c);
+	free(q->tdn->c);
+	if (q->nt > 0U) {
+		free(q->tlb);
+		free(q->tla);
+		free(q->tbb);
+		free(q->tba);
+	}
 	xfree(q);
 	return;
 }
 
 
 /* order queue operations */
-oid_t
-oq_add_order(umoq_t q, umo_t o)
+static bool
+fok_p(umoq_t q, umo_t o)
+{
+/* whether O could be filled completely right now */
+	umoq_l_t beg = um_order_side(o) == OSIDE_BUY ? q->la : q->lb;
+	uint64_t sum = 0U;
+
+	for (umoq_l_t l = beg->next; l != beg + 1; l = l->next) {
+		struct umo_s lo = {.p = l->l->p};
+
+		if (um_order_type(o) == OTYPE_MTL) {
+			/* only the top level counts */
+			if (l != beg->next) {
+				break;
+			}
+		} else if (check_limit(&lo, o)) {
+			break;
+		}
+		if ((sum += l->l->q) >= o->q) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static oid_t
+park(umoq_t q, umo_t o, umoq_o_t chain)
+{
+/* keep O off the books, on CHAIN, or in the trigger heaps if NULL */
+	umoq_o_t io;
+
+	if (UNLIKELY((io = pop_o(q)) == NULL)) {
+		return 0U;
+	}
+	*io->o = *o;
+	io->st = OSTATUS_NEW;
+	io->oid = ++q->oid;
+	io->lev = NULL;
+	if (chain != NULL) {
+		io->next = chain->next, chain->next = io;
+		io->prev = chain;
+		if (io->next != NULL) {
+			io->next->prev = io;
+		}
+	} else if (io->next = io->prev = NULL,
+		   UNLIKELY(heap_put(trig_heap(q, io->o), io) < 0)) {
+		push_o(q, io);
+		return 0U;
+	}
+	oix_put(q, io);
+	return io->oid;
+}
+
+static void
+fire_triggers(umoq_t q)
+{
+/* activate dormant orders whose trigger price has been touched,
+ * the matches of those might touch further ones */
+	while (q->trdp) {
+		struct umo_s o;
+		umoq_o_t io, mio;
+
+		if (q->tup->n && q->tup->c[0]->o->p.v <= q->last.v) {
+			heap_del(q->tup, (io = q->tup->c[0])->hix);
+		} else if (q->tdn->n && q->tdn->c[0]->o->p.v >= q->last.v) {
+			heap_del(q->tdn, (io = q->tdn->c[0])->hix);
+		} else {
+			break;
+		}
+		oix_del(q, io->oid);
+
+		/* goes in as market order, under its own id */
+		o = *io->o;
+		o.type = OTYPE_MKT;
+		q->aoid = io->oid;
+		if ((mio = match_order(q, &o)) != NULL) {
+			/* market orders don't rest */
+			push_o(q, mio);
+		}
+		q->aoid = 0U;
+		io->st = OSTATUS_FILLED;
+		push_o(q, io);
+	}
+	return;
+}
+
+static oid_t
+add1(umoq_t q, umo_t o, oid_t *aid)
 {
+/* add O, return its order id if it rests, and put the order id it
+ * trades under into AID, 0 if it was killed */
+	umoq_o_t io;
+	oid_t res = 0U;
+
+	jrnl_ev(q, OQ_JEV_ADD, 0U, o);
+	*aid = 0U;
+	switch ((otymod_t)o->tymod) {
+	case OTYMOD_STOP:
+	case OTYMOD_MIT:
+		/* dormant until the last trade touches O's price,
+		 * which might have happened already */
+		*aid = res = park(q, o, NULL);
+		goto trig;
+	case OTYMOD_OO:
+	case OTYMOD_OC:
+	case OTYMOD_OA:
+		/* wait for the auction */
+		return *aid = park(q, o, q->oo);
+	case OTYMOD_FOK:
+		if (!fok_p(q, o)) {
+			/* killed */
+			return 0U;
+		}
+		break;
+	default:
+		break;
+	}
+
+	/* O trades under the id it will rest under, if it rests at all */
+	*aid = q->aoid = ++q->oid;
+
 	/* check if the order O would cause a match
 	 * if so, make the maximum match, then process the rest
 	 * if not, or for the rest of the matched order, queue it */
-	umoq_o_t io = try_match(q, o);
+	io = match_order(q, o);
+	q->aoid = 0U;
+	if (io == NULL) {
+		/* completely matched */
+		;
+	} else if (o->tymod == OTYMOD_IOC || o->tymod == OTYMOD_FOK ||
+		   um_order_type(o) == OTYPE_MKT) {
+		/* rest is cancelled */
+		push_o(q, io);
+	} else if (UNLIKELY(add_order(q, io) < 0)) {
+		push_o(q, io);
+	} else {
+		/* flag as new */
+		io->st = OSTATUS_NEW;
+		res = io->oid = *aid;
+		oix_put(q, io);
+	}
+trig:
+	fire_triggers(q);
+	return res;
+}
 
-	/* insert the order, only if it's not completely matched */
-	if (UNLIKELY(io == NULL || add_order(q, io) < 0)) {
-		return 0;
+oid_t
+oq_add_order(umoq_t q, umo_t o)
+{
+	oid_t aid;
+	oid_t res = add1(q, o, &aid);
+
+	serve_matches(q);
+	l2_serve(q);
+	jrnl_flush(q);
+	return res;
+}
+
+size_t
+oq_add_orders(umoq_t q, oid_t *oids, const struct umo_s *os, size_t nos)
+{
+/* like oq_add_order() for each of OS but matches are served once */
+	size_t res = 0U;
+
+	for (size_t i = 0; i < nos; i++) {
+		struct umo_s o = os[i];
+		oid_t aid;
+
+		res += add1(q, &o, &aid) > 0U;
+		if (oids != NULL) {
+			oids[i] = aid;
+		}
 	}
-	/* flag as new */
-	io->st = OSTATUS_NEW;
-	return io->oid = ++q->oid;
+	serve_matches(q);
+	l2_serve(q);
+	jrnl_flush(q);
+	return res;
 }
 
 struct umo_s
@@ -617,6 +1393,8 @@ oq_cancel_order(umoq_t q, oid_t oid)
 {
 	umoq_o_t io;
 
+	jrnl_ev(q, OQ_JEV_CANCEL, oid, NULL);
+	jrnl_flush(q);
 	if (UNLIKELY((io = rem_by_oid(q, oid)) == NULL)) {
 		return -1;
 	}
@@ -625,7 +1403,7 @@ oq_cancel_order(umoq_t q, oid_t oid)
 
 	/* return the cell to our free list */
 	push_o(q, io);
-
+	l2_serve(q);
 	return 0;
 }
 
@@ -643,14 +1421,29 @@ int
 oq_suspend_order(umoq_t q, oid_t oid)
 {
 	umoq_o_t io;
-	if (UNLIKELY((io = rem_by_oid(q, oid)) == NULL)) {
+
+	jrnl_ev(q, OQ_JEV_SUSPEND, oid, NULL);
+	jrnl_flush(q);
+	if (UNLIKELY((io = find_by_oid(q, oid)) == NULL)) {
+		return -1;
+	} else if (io->lev == NULL) {
+		/* only orders on the books can be suspended */
 		return -1;
 	}
+	rem_by_oid(q, oid);
 	/* mark order as suspended */
 	io->st = OSTATUS_SUSP;
+	io->lev = NULL;
 
 	/* prepend the order to the suspension list */
 	io->next = q->os->next, q->os->next = io;
+	io->prev = q->os;
+	if (io->next != NULL) {
+		io->next->prev = io;
+	}
+	/* still ours */
+	oix_put(q, io);
+	l2_serve(q);
 	return 0;
 }
 
@@ -658,21 +1451,468 @@ int
 oq_resume_order(umoq_t q, oid_t oid)
 {
 	umoq_o_t io, mio;
+	int res = -1;
 
-	if ((io = find_by_side_by_oid(susp_head(q), oid)) == NULL) {
-		return -1;
-	} else if ((mio = try_match(q, io->o)) == NULL) {
+	jrnl_ev(q, OQ_JEV_RESUME, oid, NULL);
+	if ((io = find_by_oid(q, oid)) == NULL || io->st != OSTATUS_SUSP) {
+		goto out;
+	}
+	/* off the suspension list */
+	unlink_o(q, io);
+	oix_del(q, oid);
+	q->aoid = oid;
+	mio = match_order(q, io->o);
+	q->aoid = 0U;
+	if (mio == NULL) {
 		/* nothing left, order must have matched */
 		push_o(q, io);
-		return -1;
+		goto out;
 	}
-	/* otherwise put the order back on track */
-	add_order(q, mio);
+	/* otherwise put the order back on track, under its old id */
+	if (UNLIKELY(add_order(q, mio) < 0)) {
+		push_o(q, mio);
+		push_o(q, io);
+		goto out;
+	}
+	mio->st = OSTATUS_NEW;
+	mio->oid = oid;
+	oix_put(q, mio);
 	/* free the old bugger */
 	push_o(q, io);
+	res = 0;
+out:
+	fire_triggers(q);
+	serve_matches(q);
+	l2_serve(q);
+	jrnl_flush(q);
+	return res;
+}
+
+int
+oq_auction(umoq_t q, otymod_t which)
+{
+	umoq_o_t io, prev;
+	int res = 0;
+
+	jrnl_ev(q, OQ_JEV_AUCTION, which, NULL);
+	/* oldest parked orders go first */
+	for (io = q->oo; io->next != NULL; io = io->next);
+	for (; io != q->oo; io = prev) {
+		struct umo_s o;
+		umoq_o_t mio;
+
+		prev = io->prev;
+		if (which != OTYMOD_OA && io->o->tymod != which) {
+			continue;
+		}
+		unlink_o(q, io);
+		oix_del(q, io->oid);
+
+		/* from now on it's a day order */
+		o = *io->o;
+		o.tymod = OTYMOD_GTD;
+		q->aoid = io->oid;
+		mio = match_order(q, &o);
+		q->aoid = 0U;
+		if (mio == NULL) {
+			/* matched completely */
+			;
+		} else if (um_order_type(&o) == OTYPE_MKT ||
+			   UNLIKELY(add_order(q, mio) < 0)) {
+			push_o(q, mio);
+		} else {
+			mio->st = OSTATUS_NEW;
+			mio->oid = io->oid;
+			oix_put(q, mio);
+		}
+		push_o(q, io);
+		fire_triggers(q);
+		res++;
+	}
+	serve_matches(q);
+	l2_serve(q);
+	jrnl_flush(q);
+	return res;
+}
+
+static int
+expire_chain(umoq_t q, umoq_o_t chain)
+{
+	int res = 0;
+
+	for (umoq_o_t io = chain->next, nx; io != NULL; io = nx) {
+		nx = io->next;
+		switch ((otymod_t)io->o->tymod) {
+		case OTYMOD_GTD:
+		case OTYMOD_OO:
+		case OTYMOD_OC:
+		case OTYMOD_OA:
+			unlink_o(q, io);
+			oix_del(q, io->oid);
+			io->st = OSTATUS_EXP;
+			push_o(q, io);
+			res++;
+			break;
+		default:
+			break;
+		}
+	}
+	return res;
+}
+
+int
+oq_expire(umoq_t q)
+{
+	int res = 0;
+
+	jrnl_ev(q, OQ_JEV_EXPIRE, 0U, NULL);
+	res += expire_chain(q, q->ob);
+	res += expire_chain(q, q->oa);
+	res += expire_chain(q, q->os);
+	res += expire_chain(q, q->oo);
+	l2_serve(q);
+	jrnl_flush(q);
+	return res;
+}
+
+int
+oq_set_ladder(umoq_t q, m30_t lo, m30_t tick, size_t nticks)
+{
+	size_t nw = (nticks + 63U) / 64U;
+
+	if (q->nt > 0U) {
+		free(q->tlb);
+		free(q->tla);
+		free(q->tbb);
+		free(q->tba);
+		q->nt = 0U;
+	}
+	if (nticks == 0U) {
+		/* back to walking the levels */
+		return 0;
+	} else if (tick.v <= 0) {
+		return -1;
+	}
+	q->tlb = calloc(nticks, sizeof(*q->tlb));
+	q->tla = calloc(nticks, sizeof(*q->tla));
+	q->tbb = calloc(nw, sizeof(*q->tbb));
+	q->tba = calloc(nw, sizeof(*q->tba));
+	if (UNLIKELY(q->tlb == NULL || q->tla == NULL ||
+		     q->tbb == NULL || q->tba == NULL)) {
+		free(q->tlb);
+		free(q->tla);
+		free(q->tbb);
+		free(q->tba);
+		return -1;
+	}
+	q->tlo = lo.v;
+	q->tick = tick.v;
+	q->nt = nticks;
+
+	/* put existing levels on the ladder */
+	for (umoq_l_t l = q->lb->next; l != q->lb + 1; l = l->next) {
+		size_t i;
+
+		if ((i = lad_slot(q, l->l->p)) < q->nt) {
+			lad_put(q->tlb, q->tbb, i, l);
+		}
+	}
+	for (umoq_l_t l = q->la->next; l != q->la + 1; l = l->next) {
+		size_t i;
+
+		if ((i = lad_slot(q, l->l->p)) < q->nt) {
+			lad_put(q->tla, q->tba, i, l);
+		}
+	}
 	return 0;
 }
 
+
+/* persistence */
+int
+oq_set_journal(umoq_t q, int fd)
+{
+/* return -1 if the previous journal saw write errors */
+	int res = 0;
+
+	if (q->jfd >= 0) {
+		jrnl_flush(q);
+	}
+	if (q->jfd < 0 && q->jon) {
+		res = -1;
+	}
+	q->jfd = fd;
+	q->jon = fd >= 0;
+	return res;
+}
+
+static int
+snap_lev(int fd, umoq_l_t beg, umoq_l_t end)
+{
+	for (umoq_l_t l = beg->next; l != end; l = l->next) {
+		if (xwrite(fd, l->l, sizeof(*l->l)) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+snap_ord(int fd, umoq_o_t beg)
+{
+	struct oq_snap_ord_s buf[64U];
+	size_t nbuf = 0U;
+
+	for (umoq_o_t o = beg->next; o != NULL; o = o->next) {
+		memset(buf + nbuf, 0, sizeof(*buf));
+		buf[nbuf].o = *o->o;
+		buf[nbuf].oid = o->oid;
+		buf[nbuf].st = o->st;
+		if (++nbuf >= sizeof(buf) / sizeof(*buf) || o->next == NULL) {
+			if (xwrite(fd, buf, nbuf * sizeof(*buf)) < 0) {
+				return -1;
+			}
+			nbuf = 0U;
+		}
+	}
+	return 0;
+}
+
+static int
+snap_trig(int fd, const struct umoq_h_s *h)
+{
+/* heap order, the heap is rebuilt on loading anyway */
+	for (size_t i = 0U; i < h->n; i++) {
+		struct oq_snap_ord_s rec;
+
+		memset(&rec, 0, sizeof(rec));
+		rec.o = *h->c[i]->o;
+		rec.oid = h->c[i]->oid;
+		rec.st = h->c[i]->st;
+		if (xwrite(fd, &rec, sizeof(rec)) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int
+oq_snap(umoq_t q, int fd)
+{
+	struct oq_snap_hdr_s hdr = {
+		.magic = {'U', 'M', 'O', 'S'},
+		.ver = OQ_SNAP_VER,
+		.bom = 0x0102U,
+		.secid = q->secid,
+		.funid = q->funid,
+		.oid = q->oid,
+		.jseq = q->jseq,
+		.last = q->last,
+		.trdp = q->trdp,
+	};
+
+	/* make sure the journal is on par */
+	if (q->jfd >= 0) {
+		jrnl_flush(q);
+	}
+	for (umoq_l_t l = q->lb->next; l != q->lb + 1; l = l->next) {
+		hdr.nlev[0]++;
+	}
+	for (umoq_l_t l = q->la->next; l != q->la + 1; l = l->next) {
+		hdr.nlev[1]++;
+	}
+	for (umoq_o_t o = q->ob->next; o != NULL; o = o->next) {
+		hdr.nord[0]++;
+	}
+	for (umoq_o_t o = q->oa->next; o != NULL; o = o->next) {
+		hdr.nord[1]++;
+	}
+	for (umoq_o_t o = q->os->next; o != NULL; o = o->next) {
+		hdr.nord[2]++;
+	}
+	hdr.nord[3] = q->tup->n + q->tdn->n;
+	for (umoq_o_t o = q->oo->next; o != NULL; o = o->next) {
+		hdr.nord[4]++;
+	}
+
+	if (xwrite(fd, &hdr, sizeof(hdr)) < 0 ||
+	    snap_lev(fd, q->lb, q->lb + 1) < 0 ||
+	    snap_lev(fd, q->la, q->la + 1) < 0 ||
+	    snap_ord(fd, q->ob) < 0 ||
+	    snap_ord(fd, q->oa) < 0 ||
+	    snap_ord(fd, q->os) < 0 ||
+	    snap_trig(fd, q->tup) < 0 ||
+	    snap_trig(fd, q->tdn) < 0 ||
+	    snap_ord(fd, q->oo) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static int
+load_ord(umoq_t q, int fd, size_t n, umoq_o_t chain)
+{
+/* load N orders onto CHAIN, or the books or trigger heaps if NULL */
+	umoq_o_t tail = chain;
+
+	for (size_t i = 0U; i < n; i++) {
+		struct oq_snap_ord_s rec;
+		umoq_o_t io;
+
+		if (xread(fd, &rec, sizeof(rec)) < (ssize_t)sizeof(rec)) {
+			return -1;
+		} else if (UNLIKELY((io = pop_o(q)) == NULL)) {
+			return -1;
+		}
+		*io->o = rec.o;
+		io->oid = rec.oid;
+		io->st = (umost_t)rec.st;
+		io->lev = NULL;
+		if (chain == NULL &&
+		    (rec.o.tymod == OTYMOD_STOP || rec.o.tymod == OTYMOD_MIT)) {
+			io->next = io->prev = NULL;
+			if (heap_put(trig_heap(q, io->o), io) < 0) {
+				push_o(q, io);
+				return -1;
+			}
+		} else if (chain == NULL) {
+			/* chain order is time priority so appending will do */
+			if (add_order(q, io) < 0) {
+				push_o(q, io);
+				return -1;
+			}
+		} else {
+			/* keep the order of the list */
+			io->next = NULL;
+			io->prev = tail;
+			tail->next = io;
+			tail = io;
+		}
+		oix_put(q, io);
+	}
+	return 0;
+}
+
+static int
+load_chk(umoq_l_t beg, umoq_l_t end, const struct uml_s *lev, size_t nlev)
+{
+/* check rebuilt levels against the snapshot's */
+	umoq_l_t l = beg->next;
+	size_t i = 0U;
+
+	for (; l != end && i < nlev; l = l->next, i++) {
+		if (l->l->p.v != lev[i].p.v || l->l->q != lev[i].q) {
+			return -1;
+		}
+	}
+	return l == end && i == nlev ? 0 : -1;
+}
+
+umoq_t
+oq_load(int fd)
+{
+	struct oq_snap_hdr_s hdr;
+	struct uml_s *lev;
+	size_t nlev;
+	umoq_t res;
+	int rc = -1;
+
+	if (xread(fd, &hdr, sizeof(hdr)) < (ssize_t)sizeof(hdr)) {
+		return NULL;
+	} else if (memcmp(hdr.magic, "UMOS", sizeof(hdr.magic)) ||
+		   hdr.ver != OQ_SNAP_VER || hdr.bom != 0x0102U) {
+		return NULL;
+	}
+	/* levels come first, we rebuild them from the orders though
+	 * and use these to double-check */
+	nlev = (size_t)hdr.nlev[0] + hdr.nlev[1];
+	if ((lev = malloc((nlev + 1U) * sizeof(*lev))) == NULL) {
+		return NULL;
+	} else if (xread(fd, lev, nlev * sizeof(*lev)) <
+		   (ssize_t)(nlev * sizeof(*lev))) {
+		free(lev);
+		return NULL;
+	} else if ((res = make_oq(hdr.secid, hdr.funid)) == NULL) {
+		free(lev);
+		return NULL;
+	}
+
+	if (load_ord(res, fd, hdr.nord[0], NULL) < 0 ||
+	    load_ord(res, fd, hdr.nord[1], NULL) < 0 ||
+	    load_ord(res, fd, hdr.nord[2], res->os) < 0 ||
+	    load_ord(res, fd, hdr.nord[3], NULL) < 0 ||
+	    load_ord(res, fd, hdr.nord[4], res->oo) < 0) {
+		;
+	} else if (load_chk(res->lb, res->lb + 1, lev, hdr.nlev[0]) < 0 ||
+		   load_chk(res->la, res->la + 1,
+			    lev + hdr.nlev[0], hdr.nlev[1]) < 0) {
+		;
+	} else {
+		res->oid = hdr.oid;
+		res->jseq = hdr.jseq;
+		res->last = hdr.last;
+		res->trdp = hdr.trdp;
+		rc = 0;
+	}
+	free(lev);
+	if (rc < 0) {
+		free_oq(res);
+		return NULL;
+	}
+	return res;
+}
+
+ssize_t
+oq_replay(umoq_t q, int fd)
+{
+	struct oq_jrec_s r;
+	int jfd = q->jfd;
+	ssize_t res = 0;
+
+	/* don't journal what's in the journal already */
+	q->jfd = -1;
+	while (xread(fd, &r, sizeof(r)) == sizeof(r)) {
+		if (r.ev == OQ_JEV_MATCH || r.seq <= q->jseq) {
+			/* matches come out of the replay anyway, and
+			 * older events are covered by the snapshot */
+			continue;
+		} else if (r.seq != q->jseq + 1U) {
+			/* gap in the journal */
+			res = -1;
+			break;
+		}
+		switch ((oq_jev_t)r.ev) {
+		case OQ_JEV_ADD:
+			oq_add_order(q, &r.o);
+			break;
+		case OQ_JEV_CANCEL:
+			oq_cancel_order(q, r.oid);
+			break;
+		case OQ_JEV_SUSPEND:
+			oq_suspend_order(q, r.oid);
+			break;
+		case OQ_JEV_RESUME:
+			oq_resume_order(q, r.oid);
+			break;
+		case OQ_JEV_AUCTION:
+			oq_auction(q, (otymod_t)r.oid);
+			break;
+		case OQ_JEV_EXPIRE:
+			oq_expire(q);
+			break;
+		case OQ_JEV_MATCH:
+		default:
+			res = -1;
+			goto out;
+		}
+		res++;
+	}
+out:
+	q->jfd = jfd;
+	return res;
+}
+
+
 
 /* traversal thingamabobs */
 int
@@ -699,8 +1939,8 @@ int
 oq_trav_matches(umoq_t q, void(*cb)(umm_t, void*), void *closure)
 {
 	int res = 0;
-	for (umoq_m_t m = (q->ms + 1)->prev; m != q->ms; m = m->prev, res++) {
-		cb(m->m, closure);
+	for (uint64_t s = q->mtl; s < q->mhd; s++, res++) {
+		cb(get_m(q, s), closure);
 	}
 	return res;
 }
@@ -710,25 +1950,49 @@ int
 oq_trav_matches_rev(umoq_t q, void(*cb)(umm_t, void*), void *closure)
 {
 	int res = 0;
-	for (umoq_m_t m = q->ms->next; m != q->ms + 1; m = m->next, res++) {
-		cb(m->m, closure);
+	for (uint64_t s = q->mhd; s > q->mtl; res++) {
+		cb(get_m(q, --s), closure);
 	}
 	return res;
 }
 
+uint64_t
+oq_match_seq(umoq_t q)
+{
+	return q->mhd;
+}
+
+size_t
+oq_read_matches(umoq_t q, uint64_t *cur, struct umm_s *tgt, size_t n)
+{
+	uint64_t beg = *cur;
+
+	if (q->mhd > q->mrz && beg < q->mhd - q->mrz) {
+		/* overwritten already, skip */
+		beg = q->mhd - q->mrz;
+	}
+	if (beg >= q->mhd) {
+		return 0U;
+	}
+	n = read_m(q, beg, tgt, n);
+	*cur = beg + n;
+	return n;
+}
+
 int
 oq_clear_matches(umoq_t q)
 {
-/* return the number of matches cleared */
-	int res = 0;
-	for (umoq_m_t m = q->ms->next; m != q->ms + 1; res++) {
-		q->ms->next = m->next;
-		push_m(q, m);
-		m = q->ms->next;
-	}
-	/* make sure the back ptrs are in place */
-	(q->ms + 1)->prev = q->ms;
-	return res;
+	return clr_matches(q);
+}
+
+struct oq_hiwat_s
+oq_get_hiwat(umoq_t q)
+{
+	return (struct oq_hiwat_s){
+		.nord = mmls_hiwat(q->ols),
+		.nlev = mmls_hiwat(q->lls),
+		.nmat = q->mhiw,
+	};
 }
 
 void
@@ -739,6 +2003,47 @@ oq_register_match_cb(umoq_t q, void(*cb)(umm_t, void*), void *clo)
 	return;
 }
 
+void
+oq_register_matches_cb(
+	umoq_t q, void(*cb)(const struct umm_s*, size_t, void*), void *clo)
+{
+	q->matches_cb = cb;
+	q->matches_clo = clo;
+	return;
+}
+
+void
+oq_register_l2_cb(
+	umoq_t q, void(*cb)(const struct oq_l2u_s*, size_t, void*), void *clo)
+{
+	q->l2_cb = cb;
+	q->l2_clo = clo;
+	q->nub = 0U;
+	if (++q->ubat == 0U) {
+		q->ubat++;
+	}
+	/* subscribers start off with a full top of book */
+	memset(q->tob, 0, sizeof(q->tob));
+	q->tob[0].p.u = q->tob[1].p.u = 0xffffffffU;
+	return;
+}
+
+void
+oq_tob_sl1t(umoq_t q, struct sl1t_s *tgt)
+{
+	const struct uml_s nil = {0};
+	const struct uml_s *b = q->lb->next != q->lb + 1 ? q->lb->next->l : &nil;
+	const struct uml_s *a = q->la->next != q->la + 1 ? q->la->next->l : &nil;
+
+	sl1t_set_ttf(tgt + 0, SL1T_TTF_BID);
+	tgt[0].pri = b->p.u;
+	tgt[0].qty = ffff_m30_get_d((double)b->q).u;
+	sl1t_set_ttf(tgt + 1, SL1T_TTF_ASK);
+	tgt[1].pri = a->p.u;
+	tgt[1].qty = ffff_m30_get_d((double)a->q).u;
+	return;
+}
+
 
 #if defined STANDALONE
 /* for debugging output */
@@ -776,10 +2081,10 @@ static void
 prnt_matches(umoq_t q)
 {
 	printf("\nmatches\n");
-	for (umoq_m_t m = q->ms->next; m; m = m->next) {
+	for (uint64_t s = q->mhd; s > q->mtl;) {
+		umm_t m = get_m(q, --s);
 		printf("%u %u: %u @ %2.4f\n",
-		       m->m->ob, m->m->os,
-		       m->m->q, ffff_m30_d(m->m->p));
+		       m->ob, m->os, m->q, ffff_m30_d(m->p));
 	}
 	return;
 }
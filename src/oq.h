@@ -2,6 +2,8 @@
 #if !defined INCLUDED_oq_h_
 #define INCLUDED_oq_h_
 
+#include <stddef.h>
+#include <sys/types.h>
 #include "order.h"
 
 typedef struct umoq_s *umoq_t;
@@ -39,6 +41,17 @@ struct uml_s {
 	uint32_t q;
 };
 
+/**
+ * Market data update, level P on SIDE (an oside_t) now has quantity Q,
+ * 0 if the level is gone.  If TOB is set P and Q are the new best level
+ * on SIDE instead, both 0 if the side is empty. */
+struct oq_l2u_s {
+	uint32_t side:2;
+	uint32_t tob:1;
+	m30_t p;
+	uint32_t q;
+};
+
 
 /* ctor/dtor,
  * we expect one order queue per security, so the queue is completely
@@ -52,6 +65,15 @@ extern void free_oq(umoq_t);
  * Add an order to the queue and return an order id. */
 extern oid_t oq_add_order(umoq_t, umo_t);
 
+/**
+ * Add NOS orders from OS in one go, the order ids the orders trade
+ * under (as seen in the matches, and kept should an order rest) go
+ * to OIDS if non-NULL, 0 for orders that were killed outright.
+ * Matches of the whole batch are served once at the end.
+ * Return the number of orders now resting in the queue. */
+extern size_t
+oq_add_orders(umoq_t, oid_t *oids, const struct umo_s *os, size_t nos);
+
 /**
  * Return the order matching OID. */
 extern struct umo_s oq_get_order(umoq_t, oid_t);
@@ -72,6 +94,26 @@ extern int oq_suspend_order(umoq_t, oid_t);
  * Resume the order with the order id OID. */
 extern int oq_resume_order(umoq_t, oid_t);
 
+/**
+ * Release orders held for an auction, those with modifier WHICH
+ * (OTYMOD_OO or OTYMOD_OC), or all of them for OTYMOD_OA.
+ * There's no price discovery, released orders go through the matcher
+ * in time priority and rest as day orders.
+ * Return the number of orders released. */
+extern int oq_auction(umoq_t, otymod_t which);
+
+/**
+ * Expire all day orders and auction orders not released yet.
+ * Return the number of orders expired. */
+extern int oq_expire(umoq_t);
+
+/**
+ * For tick-sized instruments, index price levels LO, LO + TICK, ...,
+ * LO + (NTICKS - 1) * TICK directly, usually a band around the mid.
+ * Levels outside the band are still served, just not as fast.
+ * Can be called again to re-centre the ladder, NTICKS of 0 turns it off. */
+extern int oq_set_ladder(umoq_t, m30_t lo, m30_t tick, size_t nticks);
+
 
 /**
  * For status stuff. */
@@ -89,8 +131,137 @@ extern int oq_trav_matches_rev(umoq_t, void(*cb)(umm_t, void*), void *closure);
  * Clear the list of matches. */
 extern int oq_clear_matches(umoq_t);
 
+/**
+ * Return the number the next match will get, matches are numbered
+ * consecutively from 0. */
+extern uint64_t oq_match_seq(umoq_t);
+
+/**
+ * Copy up to N matches, starting at match number *CUR, to TGT and
+ * advance *CUR.  Matches stay readable (cleared or not) until the match
+ * ring wraps around, if *CUR is too old reading resumes at the oldest
+ * match still available.
+ * Return the number of matches copied. */
+extern size_t
+oq_read_matches(umoq_t, uint64_t *cur, struct umm_s *tgt, size_t n);
+
+/**
+ * Maximum number of orders, levels and matches held simultaneously. */
+struct oq_hiwat_s {
+	size_t nord;
+	size_t nlev;
+	size_t nmat;
+};
+
+extern struct oq_hiwat_s oq_get_hiwat(umoq_t);
+
+
+/* persistence */
+typedef enum {
+	OQ_JEV_UNK,
+	OQ_JEV_ADD,
+	OQ_JEV_CANCEL,
+	OQ_JEV_SUSPEND,
+	OQ_JEV_RESUME,
+	OQ_JEV_MATCH,
+	OQ_JEV_AUCTION,
+	OQ_JEV_EXPIRE,
+} oq_jev_t;
+
+/**
+ * Journal record, native byte order.
+ * SEQ numbers the events that change the books, matches carry the
+ * number of the event that caused them.  OID is set for cancel, suspend
+ * and resume events, and holds the modifier for auction events, O is the
+ * order as submitted for add events, M is the match for match events. */
+struct oq_jrec_s {
+	uint32_t seq;
+	uint32_t ev;
+	oid_t oid;
+	uint32_t pad;
+	union {
+		struct umo_s o;
+		struct umm_s m;
+	};
+};
+
+#define OQ_SNAP_VER	(2U)
+
+/**
+ * Snapshot header, followed by NLEV[0] bid and NLEV[1] ask levels
+ * (struct uml_s, best first) and NORD[0] bid, NORD[1] ask, NORD[2]
+ * suspended, NORD[3] dormant stop/MIT and NORD[4] auction orders
+ * (struct oq_snap_ord_s, in time priority except for stops/MITs). */
+struct oq_snap_hdr_s {
+	char magic[4];
+	uint16_t ver;
+	uint16_t bom;
+	insid_t secid;
+	insid_t funid;
+	oid_t oid;
+	uint32_t jseq;
+	uint32_t nlev[2];
+	uint32_t nord[5];
+	/* last traded price, if TRDP */
+	m30_t last;
+	uint32_t trdp;
+};
+
+struct oq_snap_ord_s {
+	struct umo_s o;
+	oid_t oid;
+	uint32_t st;
+};
+
+/**
+ * Append all events and matches of the queue to FD, or stop journalling
+ * if FD is -1.  Return -1 if the previous journal saw write errors. */
+extern int oq_set_journal(umoq_t, int fd);
+
+/**
+ * Write a snapshot of the queue to FD. */
+extern int oq_snap(umoq_t, int fd);
+
+/**
+ * Create a queue from the snapshot in FD, or return NULL.
+ * Ladder and callbacks have to be set up again. */
+extern umoq_t oq_load(int fd);
+
+/**
+ * Re-apply events from the journal in FD that aren't covered by the
+ * queue's last snapshot.  Matches are reproduced and served as usual.
+ * Return the number of events applied or -1 on a gap in the journal. */
+extern ssize_t oq_replay(umoq_t, int fd);
+
 /**
  * To get notified when a match occurred.  To cancel register NULL. */
 extern void oq_register_match_cb(umoq_t, void(*cb)(umm_t, void*), void *clo);
 
+/**
+ * Like oq_register_match_cb() but matches are handed over in one array,
+ * in the order they occurred, once per call to oq_add_order() or
+ * oq_add_orders().  Should memory run out the array may come in two
+ * consecutive calls.  Takes precedence over the single match callback. */
+extern void
+oq_register_matches_cb(
+	umoq_t, void(*cb)(const struct umm_s*, size_t, void*), void *clo);
+
+/**
+ * To get level updates (see struct oq_l2u_s) as they happen, coalesced
+ * per level and handed over once at the end of every queue operation,
+ * followed by top-of-book changes.  A price that is emptied and filled
+ * again within one operation may show up twice, the later entry wins.
+ * The first serving after registering always contains both tops.
+ * To cancel register NULL. */
+extern void
+oq_register_l2_cb(
+	umoq_t, void(*cb)(const struct oq_l2u_s*, size_t, void*), void *clo);
+
+struct sl1t_s;
+
+/**
+ * Put the current top of book into TGT[0] (bid) and TGT[1] (ask),
+ * only tick type, price and quantity are set. */
+extern void oq_tob_sl1t(umoq_t, struct sl1t_s *tgt);
+
 #endif	/* !INCLUDED_oq_h_ */
@@ -0,0 +1,79 @@
+/*** quod-bin.h -- binary quote snapshots as served by um-quod
+ *
+ * Copyright (C) 2012-2013 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of unsermarkt.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_quod_bin_h_
+#define INCLUDED_quod_bin_h_
+
+#include <stdint.h>
+#if defined HAVE_UTERUS_UTERUS_H
+# include <uterus/uterus.h>
+#elif defined HAVE_UTERUS_H
+# include <uterus.h>
+#else
+/* outside of our build, assume the installed layout */
+# include <uterus/uterus.h>
+#endif	/* HAVE_UTERUS_UTERUS_H || HAVE_UTERUS_H */
+
+/* A snapshot, as served under /quotbin[?idx=N][&syms], is a header
+ * followed by NREC records and, if requested, a string table of STRZ
+ * bytes holding the instruments' symbols, each nul-terminated.
+ * Everything is in the daemon's byte order, see BOM. */
+
+#define QUOD_BIN_MAGIC	"UMQB"
+#define QUOD_BIN_BOM	(0x0102U)
+
+struct quod_bin_hdr_s {
+	char magic[4];
+	/* QUOD_BIN_BOM in the daemon's byte order */
+	uint16_t bom;
+	/* size of one record */
+	uint16_t recz;
+	uint32_t nrec;
+	uint32_t strz;
+};
+
+struct quod_bin_rec_s {
+	/* instrument index, as used by /secdef and /quotreq */
+	uint16_t idx;
+	uint16_t flags;
+	/* offset of the symbol in the string table */
+	uint32_t symo;
+	/* top of the book, zeroed if never seen */
+	struct sl1t_s bid;
+	struct sl1t_s ask;
+};
+
+#endif	/* INCLUDED_quod_bin_h_ */
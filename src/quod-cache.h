@@ -49,6 +49,12 @@ typedef struct {
 	size_t sdsz;
 	const char *instrmt;
 	size_t instrmtsz;
+	/* pre-rendered <Quot> element (see web.c), QUOTZ == 0 if stale,
+	 * the ValidUntilTm value goes in at offset QUOTO */
+	char *quot;
+	size_t quotsz;
+	size_t quotz;
+	size_t quoto;
 #endif	/* HAVE_LIBFIXC_FIX_H */
 } *quod_cache_t;
 
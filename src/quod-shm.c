@@ -0,0 +1,229 @@
+/*** quod-shm.c -- quote cache export to shared memory
+ *
+ * Copyright (C) 2012-2013 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of unsermarkt.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined HAVE_UTERUS_UTERUS_H
+# include <uterus/uterus.h>
+#elif defined HAVE_UTERUS_H
+# include <uterus.h>
+#else
+# error uterus headers are mandatory
+#endif	/* HAVE_UTERUS_UTERUS_H || HAVE_UTERUS_H */
+#include "quod-shm.h"
+#include "nifty.h"
+
+static int shm_fd = -1;
+static char *shm_nm = NULL;
+static struct quod_shm_hdr_s *shm_hdr = NULL;
+static size_t shm_z = 0U;
+
+
+static int
+shm_grow(size_t ncell)
+{
+	size_t nu = sizeof(*shm_hdr) + ncell * sizeof(struct quod_shm_cell_s);
+	void *p;
+
+	/* extend the object first, readers may remap as soon as they see
+	 * the new cell count */
+	if (ftruncate(shm_fd, nu) < 0) {
+		return -1;
+	} else if (shm_hdr == NULL) {
+		p = mmap(NULL, nu, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, shm_fd, 0);
+	} else {
+		p = mremap(shm_hdr, shm_z, nu, MREMAP_MAYMOVE);
+	}
+	if (UNLIKELY(p == MAP_FAILED)) {
+		return -1;
+	}
+	shm_hdr = p;
+	shm_z = nu;
+	__atomic_store_n(&shm_hdr->ncell, (uint32_t)ncell, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static struct quod_shm_cell_s*
+shm_cell(unsigned int idx)
+{
+	if (UNLIKELY(shm_hdr == NULL || idx == 0U)) {
+		return NULL;
+	} else if (UNLIKELY(idx > shm_hdr->ncell)) {
+		size_t nu = shm_hdr->ncell;
+
+		while ((nu *= 2U) < idx);
+		if (shm_grow(nu) < 0) {
+			return NULL;
+		}
+	}
+	return QUOD_SHM_CELLS(shm_hdr) + idx - 1U;
+}
+
+static inline void
+shm_wr_beg(struct quod_shm_cell_s *c)
+{
+	__atomic_store_n(&c->seq, c->seq + 1U, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return;
+}
+
+static inline void
+shm_wr_end(struct quod_shm_cell_s *c)
+{
+	__atomic_store_n(&c->seq, c->seq + 1U, __ATOMIC_RELEASE);
+	return;
+}
+
+static bool
+shm_stale(const char *name)
+{
+/* return true if there's no object NAME or its daemon is gone */
+	struct quod_shm_hdr_s *h;
+	struct stat st;
+	uint32_t pid;
+	int fd;
+
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+		return errno == ENOENT;
+	} else if (fstat(fd, &st) < 0) {
+		close(fd);
+		return false;
+	} else if ((size_t)st.st_size < sizeof(*h)) {
+		/* its daemon died before the header was in place */
+		close(fd);
+		return true;
+	}
+	h = mmap(NULL, sizeof(*h), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (UNLIKELY(h == MAP_FAILED)) {
+		return false;
+	}
+	pid = __atomic_load_n(&h->pid, __ATOMIC_ACQUIRE);
+	munmap(h, sizeof(*h));
+	return pid == 0U || (kill((pid_t)pid, 0) < 0 && errno == ESRCH);
+}
+
+
+int
+quod_shm_init(const char *name)
+{
+	if (!shm_stale(name)) {
+		/* another daemon is still serving under that name */
+		errno = EEXIST;
+		return -1;
+	}
+	/* start afresh, readers of a previous incarnation keep theirs */
+	shm_unlink(name);
+	if ((shm_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+		return -1;
+	} else if (shm_grow(256U) < 0) {
+		close(shm_fd);
+		shm_unlink(name);
+		shm_fd = -1;
+		return -1;
+	}
+	memcpy(shm_hdr->magic, QUOD_SHM_MAGIC, sizeof(shm_hdr->magic));
+	shm_hdr->ver = QUOD_SHM_VERSION;
+	shm_hdr->cellz = sizeof(struct quod_shm_cell_s);
+	__atomic_store_n(&shm_hdr->pid, (uint32_t)getpid(), __ATOMIC_RELEASE);
+	shm_nm = strdup(name);
+	return 0;
+}
+
+void
+quod_shm_fini(void)
+{
+	if (shm_hdr == NULL) {
+		return;
+	}
+	/* tell readers we're gone */
+	__atomic_store_n(&shm_hdr->pid, 0U, __ATOMIC_RELEASE);
+	munmap(shm_hdr, shm_z);
+	close(shm_fd);
+	shm_unlink(shm_nm);
+	free(shm_nm);
+	shm_hdr = NULL;
+	shm_z = 0U;
+	shm_fd = -1;
+	shm_nm = NULL;
+	return;
+}
+
+void
+quod_shm_bang(unsigned int idx,
+	      const struct sl1t_s *bid, const struct sl1t_s *ask)
+{
+	struct quod_shm_cell_s *c;
+
+	if ((c = shm_cell(idx)) == NULL) {
+		return;
+	}
+	shm_wr_beg(c);
+	c->idx = (uint16_t)idx;
+	c->bid = *bid;
+	c->ask = *ask;
+	shm_wr_end(c);
+	return;
+}
+
+void
+quod_shm_sym(unsigned int idx, const char *sym)
+{
+	struct quod_shm_cell_s *c;
+
+	if ((c = shm_cell(idx)) == NULL) {
+		return;
+	}
+	shm_wr_beg(c);
+	c->idx = (uint16_t)idx;
+	strncpy(c->sym, sym, sizeof(c->sym) - 1U);
+	c->sym[sizeof(c->sym) - 1U] = '\0';
+	shm_wr_end(c);
+	return;
+}
+
+/* quod-shm.c ends here */
@@ -0,0 +1,123 @@
+/*** quod-shm.h -- quote cache export to shared memory
+ *
+ * Copyright (C) 2012-2013 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of unsermarkt.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_quod_shm_h_
+#define INCLUDED_quod_shm_h_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#if defined HAVE_UTERUS_UTERUS_H
+# include <uterus/uterus.h>
+#elif defined HAVE_UTERUS_H
+# include <uterus.h>
+#else
+/* outside of our build, assume the installed layout */
+# include <uterus/uterus.h>
+#endif	/* HAVE_UTERUS_UTERUS_H || HAVE_UTERUS_H */
+
+/* The shared memory object consists of a header followed by NCELL
+ * cells, cell IDX - 1 holds the top of the book of instrument IDX.
+ * NCELL only ever grows (and is published after the object has been
+ * extended), so readers whose mapping is too small for the index
+ * they're after just map the object again with the new size.  PID is
+ * zeroed when the daemon goes away, in which case readers should
+ * reopen the object by name.  A second daemon won't take over the
+ * name as long as PID is alive.
+ *
+ * Cells are guarded by a sequence lock, SEQ is odd while the cell is
+ * being written and 0 if it's never been written, use quod_shm_get()
+ * to obtain a consistent copy. */
+
+#define QUOD_SHM_MAGIC		"UMQS"
+#define QUOD_SHM_VERSION	(1U)
+
+struct quod_shm_hdr_s {
+	char magic[4];
+	uint16_t ver;
+	/* size of one cell */
+	uint16_t cellz;
+	uint32_t ncell;
+	uint32_t pid;
+	char pad[48];
+} __attribute__((aligned(64)));
+
+struct quod_shm_cell_s {
+	uint32_t seq;
+	uint16_t idx;
+	uint16_t flags;
+	struct sl1t_s bid;
+	struct sl1t_s ask;
+	char sym[88];
+} __attribute__((aligned(64)));
+
+#define QUOD_SHM_CELLS(hdr)	((struct quod_shm_cell_s*)((hdr) + 1))
+
+
+/* writer side, as used by um-quod */
+extern int quod_shm_init(const char *name);
+extern void quod_shm_fini(void);
+
+/**
+ * Publish the top of the book of instrument IDX. */
+extern void
+quod_shm_bang(unsigned int idx,
+	      const struct sl1t_s *bid, const struct sl1t_s *ask);
+
+/**
+ * Publish the symbol of instrument IDX. */
+extern void quod_shm_sym(unsigned int idx, const char *sym);
+
+
+/* reader side */
+static inline bool
+quod_shm_get(struct quod_shm_cell_s *restrict tgt,
+	     const struct quod_shm_cell_s *c)
+{
+/* copy cell C to TGT, return false if C has never been written */
+	uint32_t s1;
+	uint32_t s2;
+
+	do {
+		while ((s1 = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE)) & 1U);
+		memcpy(tgt, c, sizeof(*tgt));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+	} while (s1 != s2);
+	return s1 != 0U;
+}
+
+#endif	/* INCLUDED_quod_shm_h_ */
@@ -0,0 +1,133 @@
+/*** sha1.c -- a tiny sha1 implementation
+ *
+ * Copyright (C) 2012-2013 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of unsermarkt.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+/* this is FIPS 180-1, no frills, meant for websocket handshakes */
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdint.h>
+#include <string.h>
+#include "sha1.h"
+
+#define ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+
+static void
+sha1_blk(uint32_t h[static 5], const uint8_t blk[static 64])
+{
+	uint32_t w[80];
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+	for (unsigned int i = 0; i < 16; i++) {
+		w[i] = (uint32_t)blk[4 * i + 0] << 24 |
+			(uint32_t)blk[4 * i + 1] << 16 |
+			(uint32_t)blk[4 * i + 2] << 8 |
+			(uint32_t)blk[4 * i + 3];
+	}
+	for (unsigned int i = 16; i < 80; i++) {
+		w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	}
+	for (unsigned int i = 0; i < 80; i++) {
+		uint32_t f, k, t;
+
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5a827999U;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1U;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8f1bbcdcU;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6U;
+		}
+		t = ROL(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = ROL(b, 30);
+		b = a;
+		a = t;
+	}
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+	return;
+}
+
+void
+sha1(uint8_t tgt[static SHA1_DIGEST_SIZE],
+     const void *msg, size_t msz)
+{
+	uint32_t h[5] = {
+		0x67452301U, 0xefcdab89U, 0x98badcfeU, 0x10325476U, 0xc3d2e1f0U,
+	};
+	const uint8_t *m = msg;
+	uint8_t blk[64];
+	uint64_t nbits = (uint64_t)msz * 8U;
+	size_t rest;
+
+	for (; msz >= sizeof(blk); m += sizeof(blk), msz -= sizeof(blk)) {
+		sha1_blk(h, m);
+	}
+
+	/* padding, the message length goes into the last 8 bytes */
+	memcpy(blk, m, rest = msz);
+	blk[rest++] = 0x80U;
+	if (rest > sizeof(blk) - 8U) {
+		memset(blk + rest, 0, sizeof(blk) - rest);
+		sha1_blk(h, blk);
+		rest = 0U;
+	}
+	memset(blk + rest, 0, sizeof(blk) - 8U - rest);
+	for (unsigned int i = 0; i < 8; i++) {
+		blk[sizeof(blk) - 1U - i] = (uint8_t)(nbits >> (8U * i));
+	}
+	sha1_blk(h, blk);
+
+	for (unsigned int i = 0; i < 5; i++) {
+		tgt[4 * i + 0] = (uint8_t)(h[i] >> 24);
+		tgt[4 * i + 1] = (uint8_t)(h[i] >> 16);
+		tgt[4 * i + 2] = (uint8_t)(h[i] >> 8);
+		tgt[4 * i + 3] = (uint8_t)(h[i]);
+	}
+	return;
+}
+
+/* sha1.c ends here */
@@ -127,6 +127,18 @@ setsock_rcvtimeo(int s, int timeo)
 	return setsockopt_int(s, SOL_SOCKET, SO_RCVTIMEO, timeo);
 }
 
+/**
+ * Set the receive buffer size of S to SZ bytes. */
+static inline int
+setsock_rcvbuf(int s, int sz)
+{
+#if defined SO_RCVBUF
+	return setsockopt_int(s, SOL_SOCKET, SO_RCVBUF, sz);
+#else  /* !SO_RCVBUF */
+	return 0;
+#endif	/* SO_RCVBUF */
+}
+
 /**
  * Do not delay packets, send them right off. */
 static inline int
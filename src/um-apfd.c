@@ -106,6 +106,7 @@
 #include "ud-sock.h"
 #include "gq.h"
 #include "web.h"
+#include "ute-bg.h"
 #include "apfd-cache.h"
 
 #if defined __INTEL_COMPILER
@@ -196,7 +197,7 @@ struct pos_s {
 	unsigned int last_seen;
 };
 
-/* children need access to beef resources */
+/* beef channels */
 static ev_io *beef = NULL;
 static size_t nbeef = 0;
 
@@ -757,7 +758,7 @@ snarf_pos_rpt(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux)
 #endif	/* HAVE_LIBFIXC_FIX_H */
 
 static void
-rotate_outfile(EV_P)
+rotate_outfile(void)
 {
 	struct tm tm[1];
 	static char nu_fn[256];
@@ -775,49 +776,25 @@ rotate_outfile(EV_P)
 	strftime(n, sizeof(nu_fn) - (n - nu_fn), "%Y-%m-%dT%H:%M:%S.ute\0", tm);
 	ute_set_fn(uctx, nu_fn);
 
-	/* magic */
-	switch (fork()) {
-	case -1:
-		fprintf(logerr, "cannot fork :O\n");
-		return;
-
-	default: {
-		/* i am the parent */
+	/* open a new file and hand the old one to a background thread
+	 * for sorting and flushing, the capture loop won't notice */
+	{
 		utectx_t nu = ute_open(u_fn, UO_CREAT | UO_RDWR | UO_TRUNC);
+
+		if (UNLIKELY(nu == NULL)) {
+			fprintf(logerr, "cannot open %s, keep dumping into %s\n",
+				u_fn, nu_fn);
+			return;
+		}
 		ign = 0;
 		ute_clone_slut(nu, uctx);
 
-		/* free resources */
-		ute_free(uctx);
+		/* the old u is done with */
+		ute_close_bg(uctx);
 		/* nu u is nu */
 		uctx = nu;
-		return;
 	}
-
-	case 0:
-		/* i am the child, just update the file name and nticks
-		 * and let unroll do the work */
-		u_fn = nu_fn;
-		/* let libev know we're a fork */
-		ev_loop_fork(EV_DEFAULT);
-
-		/* close everything but the ute file */
-		for (size_t i = 0; i < nbeef; i++) {
-			int fd = beef[i].fd;
-
-			/* just close the descriptor, as opposed to
-			 * calling ud_mcast_fini() on it */
-			ev_io_stop(EV_A_ beef + i);
-			close(fd);
-		}
-		/* pretend we're through with the beef */
-		nbeef = 0;
-
-		/* then exit */
-		ev_unloop(EV_A_ EVUNLOOP_ALL);
-		return;
-	}
-	/* not reached */
+	return;
 }
 
 /* fdfs */
@@ -909,7 +886,6 @@ dccp_data_cb(EV_P_ ev_io *w, int UNUSED(re))
 	struct websvc_s ws;
 	struct webrsp_s wr;
 	ssize_t nrd;
-	size_t nwr;
 
 	if ((nrd = read(w->fd, buf, sizeof(buf))) < 0) {
 		goto clo;
@@ -921,19 +897,12 @@ dccp_data_cb(EV_P_ ev_io *w, int UNUSED(re))
 	}
 
 	ws = websvc(buf, (size_t)nrd);
+	/* one request per connection */
+	ws.clo = true;
 	wr = web(ws);
 
-	/* send header */
-	nwr = 0;
-	for (ssize_t tmp;
-	     (tmp = send(w->fd, wr.hdr + nwr, wr.hdz - nwr, 0)) > 0 &&
-		     (nwr += tmp) < wr.hdz;);
-
-	/* send beef */
-	nwr = 0;
-	for (ssize_t tmp;
-	     (tmp = send(w->fd, wr.cnt + nwr, wr.cnz - nwr, 0)) > 0 &&
-		     (nwr += tmp) < wr.cnz;);
+	/* send header and beef */
+	send_webrsp(w->fd, &wr);
 
 	/* free resources */
 	free_webrsp(wr);
@@ -985,14 +954,14 @@ sigpipe_cb(EV_P_ ev_signal *UNUSED(w), int UNUSED(revents))
 static void
 sighup_cb(EV_P_ ev_signal *UNUSED(w), int UNUSED(revents))
 {
-	rotate_outfile(EV_A);
+	rotate_outfile();
 	return;
 }
 
 static void
 midnight_cb(EV_P_ ev_periodic *UNUSED(w), int UNUSED(r))
 {
-	rotate_outfile(EV_A);
+	rotate_outfile();
 	return;
 }
 
@@ -1241,6 +1210,8 @@ past_loop:
 	fprintf(logerr, "dumped %zu ticks, %zu ignored\n", u_nt, ign);
 	fputs(u_fn, stdout);
 	fputc('\n', stdout);
+	/* rotated files might still be being written */
+	ute_close_bg_wait();
 
 past_ute:
 	/* detaching beef channels */
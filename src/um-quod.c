@@ -74,6 +74,7 @@
 #if defined HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif	/* HAVE_SYS_MMAN_H */
+#include <pthread.h>
 
 #include <unserding/unserding.h>
 
@@ -98,7 +99,10 @@
 #include "ud-sock.h"
 #include "gq.h"
 #include "web.h"
+#include "htws.h"
+#include "ute-bg.h"
 #include "quod-cache.h"
+#include "quod-shm.h"
 
 #if defined __INTEL_COMPILER
 # pragma warning (disable:981)
@@ -119,6 +123,9 @@
 # define PRUNE_INTV	(60.0)
 #endif	/* DEBUG_FLAG */
 
+/* receive buffer size for beef channels */
+#define BEEF_RCVBUF	(4U * 1024U * 1024U)
+
 /* exposed to sub systems (like web.c) */
 void *logerr;
 #if defined DEBUG_FLAG
@@ -158,12 +165,31 @@ struct cli_s {
 struct urifq_s {
 	struct gq_s q[1];
 	struct gq_ll_s fetchq[1];
+	/* items for and from the resolver thread, guarded by rslv_mtx */
+	struct gq_ll_s rslvq[1];
+	struct gq_ll_s donq[1];
 };
 
 struct urifi_s {
 	struct gq_item_s i;
 	char uri[256];
 	uint16_t idx;
+
+	/* fetch state, HOST and PATH point into URI */
+	const char *host;
+	const char *path;
+	uint16_t port;
+	bool rslvng;
+	int rc;
+	struct addrinfo *ais;
+	struct addrinfo *aip;
+	ev_io w[1];
+	ev_timer tmo[1];
+	/* request and reply buffer, its size, fill offset and length */
+	char *buf;
+	size_t bsz;
+	size_t bof;
+	size_t blen;
 };
 
 /* ev io object queue */
@@ -174,13 +200,31 @@ struct ev_io_q_s {
 struct ev_io_i_s {
 	struct gq_item_s i;
 	ev_io w[1];
+	/* idle timer for keep-alive connections */
+	ev_timer tmo[1];
 	uint16_t idx;
-	/* reply buffer, pointer and size */
+	/* close once everything's been sent */
+	bool clo;
+	/* request buffer, its size and fill */
+	char *req;
+	size_t rqsz;
+	size_t rqz;
+	/* reply buffer, its size, send offset and fill */
 	char *rpl;
 	size_t rsz;
+	size_t rpo;
+	size_t rpz;
+
+	/* websocket mode, subscribed and yet-to-be-pushed instruments */
+	bool ws;
+	bool suball;
+	uint64_t *sub;
+	size_t nsub;
+	uint64_t *pnd;
+	size_t npnd;
 };
 
-/* children need access to beef resources */
+/* beef channels */
 static ev_io *beef = NULL;
 static size_t nbeef = 0;
 
@@ -191,25 +235,6 @@ static const int ute_oflags = UO_RDWR | UO_CREAT | UO_STREAM;
 static const int ute_oflags = UO_RDWR | UO_CREAT;
 #endif	/* UO_STREAM */
 
-
-#if !defined HAVE_UTE_FREE
-/* for the moment we provide compatibility with uterus v0.2.2 */
-struct utectx_s {
-	/** file descriptor we're banging on about */
-	int fd;
-};
-
-static void
-ute_free(utectx_t ctx)
-{
-	struct utectx_s *p = ctx;
-	close(p->fd);
-	p->fd = -1;
-	free(ctx);
-	return;
-}
-#endif	/* HAVE_UTE_FREE */
-
 
 /* we support a maximum of 64 order books atm */
 static struct cli_s *cli = NULL;
@@ -217,6 +242,18 @@ static hx_t *chx = NULL;
 static size_t ncli = 0;
 static size_t alloc_cli = 0;
 
+/* open-addressing index into CLI, slots hold cli_t values, 0 means free */
+static cli_t *cht = NULL;
+static size_t zcht = 0;
+
+/* index stats, dumped at exit */
+static struct {
+	size_t nlkup;
+	size_t nprob;
+	size_t maxprob;
+	size_t nrehash;
+} chst;
+
 /* renderer counter will be inc'd with each render_cb call */
 #define CLI(x)		(assert(x), assert(x <= ncli), cli + x - 1)
 
@@ -227,6 +264,9 @@ init_cli(void)
 	cli = mmap(NULL, 4096, PROT_MEM, MAP_MEM, -1, 0);
 	chx = mmap(NULL, 4096, PROT_MEM, MAP_MEM, -1, 0);
 	alloc_cli = 4096;
+	/* and the index, always a power of 2 number of slots */
+	cht = mmap(NULL, 4096, PROT_MEM, MAP_MEM, -1, 0);
+	zcht = 4096 / sizeof(*cht);
 	return;
 }
 
@@ -236,6 +276,7 @@ fini_cli(void)
 	/* and the list of clients */
 	munmap(cli, alloc_cli);
 	munmap(chx, alloc_cli);
+	munmap(cht, zcht * sizeof(*cht));
 	return;
 }
 
@@ -281,31 +322,80 @@ sa_eq_p(my_sockaddr_t sa1, my_sockaddr_t sa2)
 static hx_t __attribute__((pure, const))
 compute_hx(struct key_s k)
 {
-	/* we need collision stats from a production run */
-	return k.sa->sin6_family ^ k.sa->sin6_port ^
-		s6a32(k.sa)[0] ^
-		s6a32(k.sa)[1] ^
-		s6a32(k.sa)[2] ^
-		s6a32(k.sa)[3] ^
-		k.id;
+	/* fold the key into 64 bits, then finalise like murmur3 so
+	 * that the low bits (used as slot index) depend on all of it */
+	uint64_t h = ((uint64_t)s6a32(k.sa)[0] << 32U | s6a32(k.sa)[1]) ^
+		((uint64_t)s6a32(k.sa)[2] << 32U | s6a32(k.sa)[3]) ^
+		((uint64_t)k.sa->sin6_port << 16U | k.id);
+
+	h ^= h >> 33U;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33U;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33U;
+	return (hx_t)h;
+}
+
+static void
+cht_put(cli_t c)
+{
+	const size_t msk = zcht - 1U;
+
+	for (size_t i = (size_t)chx[c - 1] & msk;; i = (i + 1U) & msk) {
+		if (cht[i] == 0U) {
+			cht[i] = c;
+			break;
+		}
+	}
+	return;
+}
+
+static void
+cht_rehash(size_t nu)
+{
+/* rebuild the index with NU slots from the cli array */
+	if (nu != zcht) {
+		munmap(cht, zcht * sizeof(*cht));
+		cht = mmap(NULL, nu * sizeof(*cht), PROT_MEM, MAP_MEM, -1, 0);
+		zcht = nu;
+	} else {
+		memset(cht, 0, zcht * sizeof(*cht));
+	}
+	for (cli_t i = 1; i <= ncli; i++) {
+		cht_put(i);
+	}
+	chst.nrehash++;
+	return;
 }
 
 static cli_t
 find_cli(struct key_s k)
 {
+	const size_t msk = zcht - 1U;
 	hx_t khx = compute_hx(k);
+	size_t np = 0U;
+	cli_t res = 0U;
 
 	if (UNLIKELY(k.sa->sin6_family != AF_INET6)) {
 		return 0U;
 	}
-	for (size_t i = 0; i < ncli; i++) {
-		if (chx[i] == khx &&
-		    cli[i].id == k.id &&
-		    sa_eq_p((my_sockaddr_t)&cli[i].sa, k.sa)) {
-			return i + 1;
+	for (size_t i = (size_t)khx & msk; cht[i]; i = (i + 1U) & msk, np++) {
+		cli_t c = cht[i];
+
+		if (chx[c - 1] == khx &&
+		    cli[c - 1].id == k.id &&
+		    sa_eq_p((my_sockaddr_t)&cli[c - 1].sa, k.sa)) {
+			res = c;
+			break;
 		}
 	}
-	return 0U;
+	/* keep track of probe lengths */
+	chst.nlkup++;
+	chst.nprob += np;
+	if (UNLIKELY(np > chst.maxprob)) {
+		chst.maxprob = np;
+	}
+	return res;
 }
 
 static cli_t
@@ -322,6 +412,13 @@ add_cli(struct key_s k)
 	cli[idx].tgtid = 0;
 	cli[idx].last_seen = 0;
 	chx[idx] = compute_hx(k);
+
+	/* keep the load factor of the index below 1/2 */
+	if (UNLIKELY(2U * ncli > zcht)) {
+		cht_rehash(2U * zcht);
+	} else {
+		cht_put(idx + 1);
+	}
 	return idx + 1;
 }
 
@@ -343,7 +440,7 @@ static void
 prune_clis(void)
 {
 	struct timeval tv[1];
-	size_t nu_ncli = ncli;
+	size_t nu_ncli = 0U;
 
 	/* what's the time? */
 	gettimeofday(tv, NULL);
@@ -356,33 +453,29 @@ prune_clis(void)
 		}
 	}
 
-	/* condense the cli array a bit */
+	/* condense the cli array, hashes travel along */
 	for (cli_t i = 1; i <= ncli; i++) {
-		size_t consec;
-
-		for (consec = 0; i <= ncli && cli_pruned_p(i); i++) {
-			consec++;
-		}
-		assert(consec <= ncli);
-		assert(consec <= i);
-		if (consec && i <= ncli) {
-			/* shrink */
-			size_t nmv = ncli - i;
-
-			UMQD_DEBUG("condensing %zu/%zu clis\n", consec, ncli);
-			memcpy(CLI(i - consec), CLI(i), nmv * sizeof(*cli));
-			nu_ncli -= consec;
-		} else if (consec) {
-			UMQD_DEBUG("condensing %zu/%zu clis\n", consec, ncli);
-			nu_ncli -= consec;
+		if (cli_pruned_p(i)) {
+			continue;
+		} else if (i > ++nu_ncli) {
+			cli[nu_ncli - 1] = cli[i - 1];
+			chx[nu_ncli - 1] = chx[i - 1];
 		}
 	}
+	if (nu_ncli < ncli) {
+		UMQD_DEBUG("condensing %zu/%zu clis\n", ncli - nu_ncli, ncli);
+	}
 
 	/* let everyone know how many clis we've got */
 	ncli = nu_ncli;
+	/* cli indices have moved, rebuild the index */
+	cht_rehash(zcht);
+	UMQD_DEBUG("cli index: %zu lookups, %zu probes, max %zu\n",
+		   chst.nlkup, chst.nprob, chst.maxprob);
 	return;
 }
 
+
 
 /* networking */
 static int
@@ -454,23 +547,23 @@ rslv(struct addrinfo **res, const char *host, short unsigned int port)
 }
 
 static int
-conn(struct addrinfo *ais)
+conn_nb(const struct addrinfo *aip)
 {
-	int s = -1;
+/* start connecting to AIP, return the socket which might be
+ * still in progress, or -1 on immediate failure */
+	int s;
 
-	for (struct addrinfo *aip = ais; aip; aip = aip->ai_next) {
-		if ((s = socket(aip->ai_family, aip->ai_socktype, 0)) < 0) {
-			/* great way to start the day */
-			;
-		} else if (connect(s, aip->ai_addr, aip->ai_addrlen) < 0) {
-			/* bugger */
-			close(s);
-		} else {
-			/* yippie */
-			break;
-		}
+	if ((s = socket(aip->ai_family, aip->ai_socktype, 0)) < 0) {
+		/* great way to start the day */
+		return -1;
+	}
+	setsock_nonblock(s);
+	if (connect(s, aip->ai_addr, aip->ai_addrlen) < 0 &&
+	    errno != EINPROGRESS) {
+		/* bugger */
+		close(s);
+		return -1;
 	}
-	freeaddrinfo(ais);
 	return s;
 }
 
@@ -545,12 +638,301 @@ free_io(ev_io_i_t io)
 	return;
 }
 
+
+/* websocket subscribers, chained through their ev io objects */
+static struct gq_ll_s wsq[1];
+/* instruments updated since the last push */
+static uint64_t *ws_dirty = NULL;
+static size_t nws_dirty = 0U;
+
+#define BITS_SET(b, i)	((b)[(i) / 64U] |= 1ULL << ((i) % 64U))
+#define BITS_CLR(b, i)	((b)[(i) / 64U] &= ~(1ULL << ((i) % 64U)))
+
+static int
+bits_fit(uint64_t **b, size_t *nb, size_t i)
+{
+/* make sure bit I fits into bit set B of NB words */
+	size_t nu = i / 64U + 1U;
+
+	if (nu > *nb) {
+		uint64_t *tmp;
+
+		nu = (nu + 15U) & ~15U;
+		if (UNLIKELY((tmp = realloc(*b, nu * sizeof(*tmp))) == NULL)) {
+			return -1;
+		}
+		memset(tmp + *nb, 0, (nu - *nb) * sizeof(*tmp));
+		*b = tmp;
+		*nb = nu;
+	}
+	return 0;
+}
+
+static void
+wsq_pop(ev_io_i_t qio)
+{
+	gq_item_t i = (gq_item_t)qio;
+
+	if (i->prev != GQ_NULL_ITEM) {
+		i->prev->next = i->next;
+	} else {
+		wsq->i1st = i->next;
+	}
+	if (i->next != GQ_NULL_ITEM) {
+		i->next->prev = i->prev;
+	} else {
+		wsq->ilst = i->prev;
+	}
+	i->next = i->prev = GQ_NULL_ITEM;
+	return;
+}
+
+static void
+ws_mark(unsigned int idx)
+{
+	if (wsq->i1st == GQ_NULL_ITEM) {
+		/* no-one's listening */
+		return;
+	} else if (UNLIKELY(bits_fit(&ws_dirty, &nws_dirty, idx) < 0)) {
+		return;
+	}
+	BITS_SET(ws_dirty, idx);
+	return;
+}
+
 
 utectx_t uctx = NULL;
 static const char *u_fn = NULL;
 static size_t u_nt = 0;
 /* number of ticks ignored due to missing symbols */
 static size_t ign = 0;
+/* guards UCTX's symbol table and the UCTX pointer itself, the writer
+ * thread only takes it to swap files, never around disk i/o */
+static pthread_mutex_t uctx_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+rotate_ute(void)
+{
+/* move UCTX aside and continue in a fresh U_FN, to be called by
+ * whoever writes ticks to UCTX, i.e. the writer thread if it's on */
+	struct tm tm[1];
+	static char nu_fn[256];
+	char *n = nu_fn;
+	time_t now;
+	utectx_t nu;
+	utectx_t old;
+
+	/* get a recent time stamp */
+	now = time(NULL);
+	gmtime_r(&now, tm);
+	strncpy(n, u_fn, sizeof(nu_fn));
+	n += strlen(u_fn);
+	*n++ = '-';
+	strftime(n, sizeof(nu_fn) - (n - nu_fn), "%Y-%m-%dT%H:%M:%S.ute\0", tm);
+#if defined HAVE_UTE_FREE
+	ute_set_fn(uctx, nu_fn);
+#else  /* !HAVE_UTE_FREE */
+	/* the next best thing */
+	rename(u_fn, nu_fn);
+#endif	/* HAVE_UTE_FREE */
+
+	/* open a new file and hand the old one to a background thread
+	 * for sorting and flushing, the capture loop won't notice */
+	if (UNLIKELY((nu = ute_open(u_fn, ute_oflags | UO_TRUNC)) == NULL)) {
+		fprintf(logerr, "cannot open %s, keep dumping into %s\n",
+			u_fn, nu_fn);
+		return;
+	}
+	/* symbols might be coming in as we speak */
+	pthread_mutex_lock(&uctx_mtx);
+	ute_clone_slut(nu, uctx);
+	old = uctx;
+	/* nu u is nu */
+	uctx = nu;
+	pthread_mutex_unlock(&uctx_mtx);
+
+	/* the old u is done with */
+	ute_close_bg(old);
+	return;
+}
+
+
+
+/* write-behind ring, single producer (the main loop) and single
+ * consumer (the writer thread, which owns UCTX's tick pages) */
+#define WRR_NSLOT	(65536U)
+#define WRR_BATCH	(256U)
+
+typedef enum {
+	WRR_TICK,
+	WRR_ROTATE,
+} wrr_cmd_t;
+
+struct wrr_slot_s {
+	struct sndwch_s ss[4];
+	wrr_cmd_t cmd;
+};
+
+static struct {
+	struct wrr_slot_s *s;
+	bool on;
+	bool quit;
+
+	/* producer side */
+	size_t head __attribute__((aligned(64)));
+	size_t nput;
+	size_t novr;
+	size_t maxocc;
+	/* rotation that didn't fit into the ring yet */
+	bool rotp;
+
+	/* consumer side */
+	size_t tail __attribute__((aligned(64)));
+	int zzz;
+} wrr;
+
+static pthread_t wrr_thr;
+static pthread_mutex_t wrr_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wrr_cnd = PTHREAD_COND_INITIALIZER;
+
+static int
+wrr_put(wrr_cmd_t cmd, const struct sndwch_s *ss)
+{
+	size_t h = wrr.head;
+	size_t occ = h - __atomic_load_n(&wrr.tail, __ATOMIC_ACQUIRE);
+	struct wrr_slot_s *s = wrr.s + h % WRR_NSLOT;
+
+	if (UNLIKELY(occ >= WRR_NSLOT)) {
+		return -1;
+	} else if (UNLIKELY(occ >= wrr.maxocc)) {
+		wrr.maxocc = occ + 1U;
+	}
+	s->cmd = cmd;
+	if (ss != NULL) {
+		memcpy(s->ss, ss, sizeof(s->ss));
+	}
+	__atomic_store_n(&wrr.head, h + 1U, __ATOMIC_SEQ_CST);
+
+	/* wake up the writer if it's napping */
+	if (__atomic_load_n(&wrr.zzz, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&wrr_mtx);
+		pthread_cond_signal(&wrr_cnd);
+		pthread_mutex_unlock(&wrr_mtx);
+	}
+	return 0;
+}
+
+static void
+wrr_push(const struct sndwch_s ss[static 4])
+{
+	if (UNLIKELY(wrr.rotp) && wrr_put(WRR_ROTATE, NULL) == 0) {
+		wrr.rotp = false;
+	}
+	if (UNLIKELY(wrr.rotp) || UNLIKELY(wrr_put(WRR_TICK, ss) < 0)) {
+		/* writer can't keep up, drop it */
+		wrr.novr++;
+		return;
+	}
+	wrr.nput++;
+	return;
+}
+
+static size_t
+wrr_drain(size_t n)
+{
+/* carry out up to N commands off the ring, writer thread only */
+	size_t t = wrr.tail;
+	size_t h = __atomic_load_n(&wrr.head, __ATOMIC_ACQUIRE);
+	size_t i;
+
+	for (i = 0U; t + i != h && i < n; i++) {
+		const struct wrr_slot_s *s = wrr.s + (t + i) % WRR_NSLOT;
+
+		switch (s->cmd) {
+		case WRR_TICK:
+			ute_add_tick(uctx, AS_SCOM(s->ss));
+			break;
+		case WRR_ROTATE:
+			/* ticks before this belong to the old file */
+			rotate_ute();
+			break;
+		default:
+			break;
+		}
+	}
+	__atomic_store_n(&wrr.tail, t + i, __ATOMIC_RELEASE);
+	return i;
+}
+
+static void*
+wrr_wrk(void *UNUSED(clo))
+{
+	for (;;) {
+		struct timespec ts[1];
+		size_t n;
+
+		if ((n = wrr_drain(WRR_BATCH))) {
+			continue;
+		} else if (__atomic_load_n(&wrr.quit, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		/* nothing to do, have a nap */
+		clock_gettime(CLOCK_REALTIME, ts);
+		if ((ts->tv_nsec += 100000000L) >= 1000000000L) {
+			ts->tv_sec++;
+			ts->tv_nsec -= 1000000000L;
+		}
+		pthread_mutex_lock(&wrr_mtx);
+		__atomic_store_n(&wrr.zzz, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&wrr.head, __ATOMIC_SEQ_CST) == wrr.tail &&
+		    !__atomic_load_n(&wrr.quit, __ATOMIC_ACQUIRE)) {
+			pthread_cond_timedwait(&wrr_cnd, &wrr_mtx, ts);
+		}
+		__atomic_store_n(&wrr.zzz, 0, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&wrr_mtx);
+	}
+	return NULL;
+}
+
+static int
+init_wrr(void)
+{
+	const size_t z = WRR_NSLOT * sizeof(*wrr.s);
+
+	if ((wrr.s = mmap(NULL, z, PROT_MEM, MAP_MEM, -1, 0)) == MAP_FAILED) {
+		wrr.s = NULL;
+		return -1;
+	} else if (pthread_create(&wrr_thr, NULL, wrr_wrk, NULL) != 0) {
+		munmap(wrr.s, z);
+		wrr.s = NULL;
+		return -1;
+	}
+	wrr.on = true;
+	return 0;
+}
+
+static void
+fini_wrr(void)
+{
+	if (!wrr.on) {
+		return;
+	}
+	/* let the writer drain the ring and quit */
+	pthread_mutex_lock(&wrr_mtx);
+	__atomic_store_n(&wrr.quit, true, __ATOMIC_RELEASE);
+	pthread_cond_signal(&wrr_cnd);
+	pthread_mutex_unlock(&wrr_mtx);
+	pthread_join(wrr_thr, NULL);
+	wrr.on = false;
+
+	fprintf(logerr, "writer ring: %zu ticks, %zu overruns, "
+		"max occupancy %zu/%u\n",
+		wrr.nput, wrr.novr, wrr.maxocc, WRR_NSLOT);
+	munmap(wrr.s, WRR_NSLOT * sizeof(*wrr.s));
+	wrr.s = NULL;
+	return;
+}
 
 /* value cache */
 quod_cache_t quod_cache = NULL;
@@ -620,8 +1002,16 @@ bang_q(unsigned int tgtid, scom_t sp)
 		*CACHE(tgtid - 1).ask = *AS_CONST_SL1T(sp);
 		break;
 	default:
-		break;
+		return;
 	}
+#if !defined HAVE_LIBFIXC_FIX_H
+	/* pre-rendered quote is stale now */
+	CACHE(tgtid - 1).quotz = 0UL;
+#endif	/* !HAVE_LIBFIXC_FIX_H */
+	/* push it to subscribers later on */
+	ws_mark(tgtid);
+	/* and to co-located readers */
+	quod_shm_bang(tgtid, CACHE(tgtid - 1).bid, CACHE(tgtid - 1).ask);
 	return;
 }
 
@@ -847,7 +1237,8 @@ bang_sym(cli_t c, const struct um_qmeta_s qm[static 1])
 }
 
 static void
-snarf_meta(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux)
+snarf_meta(
+	const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux, uint32_t now)
 {
 	struct um_qmeta_s brg[1];
 	struct key_s k = {
@@ -873,6 +1264,7 @@ snarf_meta(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux)
 	bang_sym(c, brg);
 
 	/* check if we know about the symbol */
+	pthread_mutex_lock(&uctx_mtx);
 	if ((id = ute_sym2idx(uctx, CLI(c)->sym)) == CLI(c)->tgtid) {
 		/* yep, known and it's the same id, brilliant */
 		;
@@ -888,14 +1280,16 @@ snarf_meta(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux)
 		ute_bang_symidx(uctx, CLI(c)->sym, CLI(c)->tgtid);
 		peruse_uri = 1;
 	}
+	pthread_mutex_unlock(&uctx_mtx);
 
-	/* leave a last_seen note */
-	{
-		struct timeval tv[1];
-		gettimeofday(tv, NULL);
-		CLI(c)->last_seen = tv->tv_sec;
+	if (peruse_uri) {
+		/* let shm readers know */
+		quod_shm_sym(CLI(c)->tgtid, CLI(c)->sym);
 	}
 
+	/* leave a last_seen note */
+	CLI(c)->last_seen = now;
+
 	/* next up is brag uri, possibly */
 	if (peruse_uri && brg->uri != NULL) {
 		urifi_t fi = make_uri();
@@ -910,7 +1304,8 @@ snarf_meta(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux)
 }
 
 static void
-snarf_data(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux)
+snarf_data(
+	const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux, uint32_t now)
 {
 	struct sndwch_s ss[4];
 	cli_t c;
@@ -948,85 +1343,31 @@ snarf_data(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux)
 
 	/* fiddle with the tblidx */
 	scom_thdr_set_tblidx(AS_SCOM_THDR(ss), CLI(c)->tgtid);
-	/* and pump the tick to ute */
-	ute_add_tick(uctx, AS_SCOM(ss));
+	/* and pump the tick to ute, or have it pumped */
+	if (wrr.on) {
+		wrr_push(ss);
+	} else {
+		ute_add_tick(uctx, AS_SCOM(ss));
+	}
 
 	/* leave a last_seen note */
-	{
-		struct timeval tv[1];
-		gettimeofday(tv, NULL);
-		CLI(c)->last_seen = tv->tv_sec;
-	}
+	CLI(c)->last_seen = now;
 	return;
 }
 
 static void
-rotate_outfile(EV_P)
+rotate_outfile(void)
 {
-	struct tm tm[1];
-	static char nu_fn[256];
-	char *n = nu_fn;
-	time_t now;
-
 	fprintf(logerr, "rotate...\n");
+	ign = 0;
 
-	/* get a recent time stamp */
-	now = time(NULL);
-	gmtime_r(&now, tm);
-	strncpy(n, u_fn, sizeof(nu_fn));
-	n += strlen(u_fn);
-	*n++ = '-';
-	strftime(n, sizeof(nu_fn) - (n - nu_fn), "%Y-%m-%dT%H:%M:%S.ute\0", tm);
-#if defined HAVE_UTE_FREE
-	ute_set_fn(uctx, nu_fn);
-#else  /* !HAVE_UTE_FREE */
-	/* the next best thing */
-	rename(u_fn, nu_fn);
-#endif	/* HAVE_UTE_FREE */
-
-	/* magic */
-	switch (fork()) {
-	case -1:
-		fprintf(logerr, "cannot fork :O\n");
-		return;
-
-	default: {
-		/* i am the parent */
-		utectx_t nu = ute_open(u_fn, ute_oflags | UO_TRUNC);
-		ign = 0;
-		ute_clone_slut(nu, uctx);
-
-		/* free resources */
-		ute_free(uctx);
-		/* nu u is nu */
-		uctx = nu;
-		return;
+	if (!wrr.on) {
+		rotate_ute();
+	} else if (wrr_put(WRR_ROTATE, NULL) < 0) {
+		/* ring's full, the next tick will take it along */
+		wrr.rotp = true;
 	}
-
-	case 0:
-		/* i am the child, just update the file name and nticks
-		 * and let unroll do the work */
-		u_fn = nu_fn;
-		/* let libev know we're a fork */
-		ev_loop_fork(EV_DEFAULT);
-
-		/* close everything but the ute file */
-		for (size_t i = 0; i < nbeef; i++) {
-			int fd = beef[i].fd;
-
-			/* just close the descriptor, as opposed to
-			 * calling ud_mcast_fini() on it */
-			ev_io_stop(EV_A_ beef + i);
-			close(fd);
-		}
-		/* pretend we're through with the beef */
-		nbeef = 0;
-
-		/* then exit */
-		ev_unloop(EV_A_ EVUNLOOP_ALL);
-		return;
-	}
-	/* not reached */
+	return;
 }
 
 /* fdfs */
@@ -1048,7 +1389,23 @@ ev_qio_shut(EV_P_ ev_io *w)
 /* attention, W *must* come from the ev io queue */
 	ev_io_i_t qio = w->data;
 
+	ev_timer_stop(EV_A_ qio->tmo);
 	ev_io_shut(EV_A_ w);
+	if (qio->ws) {
+		wsq_pop(qio);
+	}
+	if (qio->req != NULL) {
+		free(qio->req);
+	}
+	if (qio->rpl != NULL) {
+		free(qio->rpl);
+	}
+	if (qio->sub != NULL) {
+		free(qio->sub);
+	}
+	if (qio->pnd != NULL) {
+		free(qio->pnd);
+	}
 	free_io(qio);
 	return;
 }
@@ -1079,100 +1436,330 @@ make_brag_uri(my_sockaddr_t sa, socklen_t UNUSED(sa_len))
 	return 0;
 }
 
+/* secdef fetching, the resolver runs in a thread of its own,
+ * everything else is non-blocking and driven by the main loop */
+#define FETCH_TIMEOUT	(10.0)
+#define FETCH_MAXZ	(16U * 1024U * 1024U)
+
+static pthread_t rslv_thr;
+static pthread_mutex_t rslv_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rslv_cnd = PTHREAD_COND_INITIALIZER;
+static struct ev_loop *rslv_loop;
+static ev_async rslv_asy[1];
+static bool rslv_quit;
+
+static void*
+rslv_wrk(void *UNUSED(clo))
+{
+	pthread_mutex_lock(&rslv_mtx);
+	while (!rslv_quit) {
+		urifi_t fi;
+
+		if ((fi = (void*)gq_pop_head(urifq.rslvq)) == NULL) {
+			pthread_cond_wait(&rslv_cnd, &rslv_mtx);
+			continue;
+		}
+		pthread_mutex_unlock(&rslv_mtx);
+
+		/* this is the bit that may take ages */
+		if ((fi->rc = rslv(&fi->ais, fi->host, fi->port)) != 0) {
+			fi->ais = NULL;
+		}
+
+		pthread_mutex_lock(&rslv_mtx);
+		gq_push_tail(urifq.donq, (gq_item_t)fi);
+		ev_async_send(rslv_loop, rslv_asy);
+	}
+	pthread_mutex_unlock(&rslv_mtx);
+	return NULL;
+}
+
 static int
-snarf_uri(char *restrict uri)
+snarf_uri(urifi_t fi)
 {
-	struct addrinfo *ais = NULL;
-	const char *host;
-	char *path;
+	char *host;
 	char *p;
-	uint16_t port;
-	int s;
 
 	/* snarf host and path from uri */
-	if ((host = strstr(uri, "://")) == NULL) {
-		fprintf(logerr, "cannot snarf host part off %s\n", uri);
+	if ((host = strstr(fi->uri, "://")) == NULL) {
+		fprintf(logerr, "cannot snarf host part off %s\n", fi->uri);
 		return -1;
 	} else if ((p = strchr(host += 3, '/')) == NULL) {
-		fprintf(logerr, "no path in URI %s\n", uri);
+		fprintf(logerr, "no path in URI %s\n", fi->uri);
 		return -1;
 	}
 	/* fiddle with the string a bit */
 	*p = '\0';
-	path = p + 1;
+	fi->path = p + 1;
+	fi->host = host;
 
 	/* try and find a port number */
 	if ((p = strchr(host, ':'))) {
 		*p = '\0';
-		port = strtoul(p + 1, NULL, 10);
+		fi->port = strtoul(p + 1, NULL, 10);
 	} else {
-		port = 80U;
+		fi->port = 80U;
 	}
+	return 0;
+}
 
-	/* connection guts */
-	if (rslv(&ais, host, port) < 0) {
-		fprintf(logerr, "cannot resolve %s %hu\n", host, port);
-		return -1;
-	} else if ((s = conn(ais)) < 0) {
-		fprintf(logerr, "cannot connect to %s %hu\n", host, port);
-		return -1;
+static void
+fetch_fini(EV_P_ urifi_t fi)
+{
+	if (fi->w->fd >= 0) {
+		ev_io_stop(EV_A_ fi->w);
+		close(fi->w->fd);
+		fi->w->fd = -1;
 	}
-	/* yay */
-	UMQD_DEBUG("d/l'ing /%s off %s %hu\n", path, host, port);
-	{
-		static char req[256] = "GET /";
-		size_t plen = strlen(path);
+	ev_timer_stop(EV_A_ fi->tmo);
+	if (fi->ais != NULL) {
+		freeaddrinfo(fi->ais);
+	}
+	if (fi->buf != NULL) {
+		free(fi->buf);
+	}
+	free_uri(fi);
+	return;
+}
 
-		memcpy(req + 5, path, plen);
-		memcpy(req + 5 + plen, "\r\n\r\n", 5);
-		send(s, req, plen + 10, 0);
+static bool
+fetch_rpl_done_p(const char *buf, size_t bsz)
+{
+/* check if the reply in BUF is complete according to its headers */
+	static char hdr_cont_len[] = "Content-Length:";
+	static char delim[] = "\r\n\r\n";
+	const char *p;
+	const char *eoh;
+	long int sz;
+
+	if ((eoh = strstr(buf, delim)) == NULL) {
+		/* headers aren't through yet */
+		return false;
+	} else if ((p = strcasestr(buf, hdr_cont_len)) == NULL || p > eoh) {
+		/* no length, wait for EOF then */
+		return false;
+	} else if ((sz = strtol(p + sizeof(hdr_cont_len) - 1, NULL, 10)) < 0) {
+		/* too weird, don't wait for more */
+		return true;
 	}
-	return s;
+	return (size_t)(eoh + 4 - buf + sz) <= bsz;
 }
 
 static void
 fetch_data_cb(EV_P_ ev_io *w, int UNUSED(re))
 {
-	static char rpl[4096];
-	ev_io_i_t qio;
+	urifi_t fi = w->data;
 	ssize_t nrd;
 
-	if (UNLIKELY((qio = w->data) == NULL)) {
-		goto clo;
-	} else if ((nrd = read(w->fd, rpl, sizeof(rpl))) < 0) {
+	if (fi->bof + 1U >= fi->bsz) {
+		/* make some room, keep space for a \nul */
+		size_t nu = fi->bsz * 2U;
+		char *tmp;
+
+		if (UNLIKELY(nu > FETCH_MAXZ)) {
+			fprintf(logerr, "secdef for %hu too large\n", fi->idx);
+			goto clo;
+		} else if (UNLIKELY((tmp = realloc(fi->buf, nu)) == NULL)) {
+			goto clo;
+		}
+		fi->buf = tmp;
+		fi->bsz = nu;
+	}
+
+	nrd = read(w->fd, fi->buf + fi->bof, fi->bsz - fi->bof - 1U);
+	if (nrd < 0 && (errno == EAGAIN || errno == EINTR)) {
+		/* come back later */
+		return;
+	} else if (nrd < 0) {
 		goto clo;
-	} else if ((size_t)nrd < sizeof(rpl)) {
-		rpl[nrd] = '\0';
-	} else {
-		/* uh oh, mega request, wtf? */
-		rpl[sizeof(rpl) - 1] = '\0';
+	} else if (nrd > 0) {
+		fi->bof += nrd;
+		fi->buf[fi->bof] = '\0';
+		if (!fetch_rpl_done_p(fi->buf, fi->bof)) {
+			/* more to come */
+			return;
+		}
 	}
 
-	/* quick parsing */
-	massage_fetch_uri_rpl(rpl, nrd, qio->idx);
+	/* quick parsing, we're either at EOF or everything's there */
+	massage_fetch_uri_rpl(fi->buf, fi->bof, fi->idx);
 
 clo:
-	ev_qio_shut(EV_A_ w);
+	fetch_fini(EV_A_ fi);
 	return;
 }
 
 static void
-check_urifq(EV_P)
+fetch_send_cb(EV_P_ ev_io *w, int UNUSED(re))
 {
-	for (urifi_t fi; (fi = pop_uri()); free_uri(fi)) {
-		ev_io_i_t qio;
-		int s;
+	urifi_t fi = w->data;
+	ssize_t nwr;
+
+	nwr = send(w->fd, fi->buf + fi->bof, fi->blen - fi->bof, 0);
+	if (nwr < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return;
+	} else if (nwr < 0) {
+		fetch_fini(EV_A_ fi);
+		return;
+	} else if ((fi->bof += nwr) < fi->blen) {
+		/* partial write */
+		return;
+	}
+
+	/* request's out, reuse the buffer for the reply */
+	fi->bof = 0U;
+	fi->buf[0] = '\0';
+	ev_io_stop(EV_A_ w);
+	ev_io_init(w, fetch_data_cb, w->fd, EV_READ);
+	ev_io_start(EV_A_ w);
+	return;
+}
+
+static void fetch_conn(EV_P_ urifi_t fi);
+
+static void
+fetch_conn_cb(EV_P_ ev_io *w, int UNUSED(re))
+{
+	urifi_t fi = w->data;
+	int fd = w->fd;
 
-		if ((s = snarf_uri(fi->uri)) < 0) {
+	ev_io_stop(EV_A_ w);
+	if (getsockopt_int(fd, SOL_SOCKET, SO_ERROR) != 0) {
+		/* try the next address */
+		close(fd);
+		w->fd = -1;
+		fi->aip = fi->aip->ai_next;
+		fetch_conn(EV_A_ fi);
+		return;
+	}
+
+	/* yay */
+	UMQD_DEBUG("d/l'ing /%s off %s %hu\n", fi->path, fi->host, fi->port);
+	{
+		size_t plen = strlen(fi->path);
+
+		fi->bsz = 4096U;
+		if (UNLIKELY((fi->buf = malloc(fi->bsz)) == NULL)) {
+			fetch_fini(EV_A_ fi);
+			return;
+		}
+		/* PATH is part of URI so it's guaranteed to fit */
+		memcpy(fi->buf, "GET /", 5);
+		memcpy(fi->buf + 5, fi->path, plen);
+		memcpy(fi->buf + 5 + plen, "\r\n\r\n", 5);
+		fi->blen = plen + 9U;
+		fi->bof = 0U;
+	}
+	ev_io_init(w, fetch_send_cb, fd, EV_WRITE);
+	ev_io_start(EV_A_ w);
+	return;
+}
+
+static void
+fetch_conn(EV_P_ urifi_t fi)
+{
+	for (int s; fi->aip; fi->aip = fi->aip->ai_next) {
+		if ((s = conn_nb(fi->aip)) >= 0) {
+			ev_io_init(fi->w, fetch_conn_cb, s, EV_WRITE);
+			fi->w->data = fi;
+			ev_io_start(EV_A_ fi->w);
+			return;
+		}
+	}
+	fprintf(logerr, "cannot connect to %s %hu\n", fi->host, fi->port);
+	fetch_fini(EV_A_ fi);
+	return;
+}
+
+static void
+fetch_tmo_cb(EV_P_ ev_timer *w, int UNUSED(re))
+{
+	urifi_t fi = w->data;
+
+	fprintf(logerr, "fetching off %s %hu timed out\n", fi->host, fi->port);
+	if (fi->rslvng) {
+		/* the resolver's still got it, rslv_cb() will clean up */
+		return;
+	}
+	fetch_fini(EV_A_ fi);
+	return;
+}
+
+static void
+rslv_cb(EV_P_ ev_async *UNUSED(w), int UNUSED(re))
+{
+	struct gq_ll_s don[1];
+
+	/* steal the list of resolved items */
+	pthread_mutex_lock(&rslv_mtx);
+	*don = *urifq.donq;
+	urifq.donq->i1st = urifq.donq->ilst = GQ_NULL_ITEM;
+	pthread_mutex_unlock(&rslv_mtx);
+
+	for (urifi_t fi; (fi = (void*)gq_pop_head(don));) {
+		fi->rslvng = false;
+		if (!ev_is_active(fi->tmo)) {
+			/* timed out already, the timeout callback has
+			 * left the item to us */
+			fetch_fini(EV_A_ fi);
+			continue;
+		} else if (fi->rc != 0) {
+			fprintf(logerr, "cannot resolve %s %hu\n",
+				fi->host, fi->port);
+			fetch_fini(EV_A_ fi);
 			continue;
 		}
+		fi->aip = fi->ais;
+		fetch_conn(EV_A_ fi);
+	}
+	return;
+}
 
-		/* retrieve the result through our queue */
-		qio = make_io();
-		ev_io_init(qio->w, fetch_data_cb, s, EV_READ);
-		qio->idx = fi->idx;
-		qio->w->data = qio;
-		ev_io_start(EV_A_ qio->w);
+static void
+init_rslv(EV_P)
+{
+	rslv_loop = EV_A;
+	ev_async_init(rslv_asy, rslv_cb);
+	ev_async_start(EV_A_ rslv_asy);
+	if (pthread_create(&rslv_thr, NULL, rslv_wrk, NULL) != 0) {
+		fputs("cannot start resolver thread\n", logerr);
+	}
+	return;
+}
+
+static void
+fini_rslv(EV_P)
+{
+	pthread_mutex_lock(&rslv_mtx);
+	rslv_quit = true;
+	pthread_cond_signal(&rslv_cnd);
+	pthread_mutex_unlock(&rslv_mtx);
+	pthread_join(rslv_thr, NULL);
+	ev_async_stop(EV_A_ rslv_asy);
+	return;
+}
+
+static void
+check_urifq(EV_P)
+{
+	for (urifi_t fi; (fi = pop_uri());) {
+		if (snarf_uri(fi) < 0) {
+			free_uri(fi);
+			continue;
+		}
+
+		/* time the whole thing out eventually */
+		fi->w->fd = -1;
+		ev_timer_init(fi->tmo, fetch_tmo_cb, FETCH_TIMEOUT, 0.0);
+		fi->tmo->data = fi;
+		ev_timer_start(EV_A_ fi->tmo);
+
+		/* let the resolver have a go */
+		fi->rslvng = true;
+		pthread_mutex_lock(&rslv_mtx);
+		gq_push_tail(urifq.rslvq, (gq_item_t)fi);
+		pthread_cond_signal(&rslv_cnd);
+		pthread_mutex_unlock(&rslv_mtx);
 	}
 	return;
 }
@@ -1195,7 +1782,11 @@ mon_beef_cb(EV_P_ ev_io *w, int UNUSED(revents))
 {
 	struct ud_msg_s msg[1];
 	ud_sock_t s = w->data;
+	/* one time stamp for the whole batch, last_seen is in seconds
+	 * anyway and the loop time comes without a syscall */
+	uint32_t now = (uint32_t)ev_now(EV_A);
 
+	/* drain the socket */
 	while (ud_chck_msg(msg, s) >= 0) {
 		struct ud_auxmsg_s aux[1];
 
@@ -1205,11 +1796,11 @@ mon_beef_cb(EV_P_ ev_io *w, int UNUSED(revents))
 
 		switch (msg->svc) {
 		case UTE_QMETA:
-			snarf_meta(msg, aux);
+			snarf_meta(msg, aux, now);
 			break;
 
 		case UTE_CMD:
-			snarf_data(msg, aux);
+			snarf_data(msg, aux, now);
 			break;
 		default:
 			break;
@@ -1218,46 +1809,414 @@ mon_beef_cb(EV_P_ ev_io *w, int UNUSED(revents))
 	return;
 }
 
+/* keep-alive connections idling longer than this are shut */
+#define QIO_TIMEOUT	(30.0)
+/* largest request we're prepared to buffer */
+#define QIO_MAXREQ	(65536U)
+
+static int
+qio_buf(ev_io_i_t qio, const struct iovec *v, size_t nv)
+{
+/* append the scatter-gather list V to QIO's reply buffer */
+	size_t z = 0UL;
+
+	for (size_t i = 0; i < nv; i++) {
+		z += v[i].iov_len;
+	}
+	if (qio->rpo > 0U) {
+		/* compact first */
+		memmove(qio->rpl, qio->rpl + qio->rpo, qio->rpz - qio->rpo);
+		qio->rpz -= qio->rpo;
+		qio->rpo = 0U;
+	}
+	if (qio->rpz + z > qio->rsz) {
+		size_t nu = qio->rsz ?: 4096U;
+		char *tmp;
+
+		while (nu < qio->rpz + z) {
+			nu *= 2U;
+		}
+		if (UNLIKELY((tmp = realloc(qio->rpl, nu)) == NULL)) {
+			return -1;
+		}
+		qio->rpl = tmp;
+		qio->rsz = nu;
+	}
+	for (size_t i = 0; i < nv; i++) {
+		memcpy(qio->rpl + qio->rpz, v[i].iov_base, v[i].iov_len);
+		qio->rpz += v[i].iov_len;
+	}
+	return 0;
+}
+
+static int
+qio_send(ev_io_i_t qio, struct webrsp_s *wr)
+{
+/* send WR unless there's stuff queued up already, keep what's left */
+	ssize_t rest = wr->len;
+
+	if (qio->rpo >= qio->rpz && (rest = send_webrsp(qio->w->fd, wr)) < 0) {
+		return -1;
+	} else if (rest > 0 && qio_buf(qio, wr->iov, wr->niov) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
 static void
-dccp_data_cb(EV_P_ ev_io *w, int UNUSED(re))
+qio_want(EV_P_ ev_io_i_t qio)
 {
-	static char buf[65536];
-	struct websvc_s ws;
-	struct webrsp_s wr;
-	ssize_t nrd;
-	size_t nwr;
+/* stop reading while there's a reply to be sent */
+	int ev = qio->rpo < qio->rpz ? EV_WRITE : EV_READ;
 
-	if ((nrd = read(w->fd, buf, sizeof(buf))) < 0) {
-		goto clo;
-	} else if ((size_t)nrd < sizeof(buf)) {
-		buf[nrd] = '\0';
+	if ((qio->w->events & (EV_READ | EV_WRITE)) != ev) {
+		ev_io_stop(EV_A_ qio->w);
+		ev_io_set(qio->w, qio->w->fd, ev);
+		ev_io_start(EV_A_ qio->w);
+	}
+	return;
+}
+
+static int
+ws_sub(ev_io_i_t qio, unsigned int idx, bool on)
+{
+/* (un)subscribe QIO to IDX, subscriptions get an initial push */
+	size_t nsy;
+
+	pthread_mutex_lock(&uctx_mtx);
+	nsy = ute_nsyms(uctx);
+	pthread_mutex_unlock(&uctx_mtx);
+
+	if (idx == WEBSVC_ALL) {
+		if (!(qio->suball = on)) {
+			memset(qio->sub, 0, qio->nsub * sizeof(*qio->sub));
+			return 0;
+		} else if (nsy == 0U) {
+			return 0;
+		} else if (bits_fit(&qio->pnd, &qio->npnd, nsy) < 0) {
+			return -1;
+		}
+		for (size_t i = 1U; i <= nsy; i++) {
+			BITS_SET(qio->pnd, i);
+		}
+		return 0;
+	} else if (idx == 0U) {
+		return 0;
+	} else if (bits_fit(&qio->sub, &qio->nsub, idx) < 0) {
+		return -1;
+	} else if (!on) {
+		if (qio->suball) {
+			/* ws_push() ignores SUB while SUBALL is on,
+			 * spell out what we know of instead */
+			if (bits_fit(&qio->sub, &qio->nsub, nsy) < 0) {
+				return -1;
+			}
+			for (size_t i = 1U; i <= nsy; i++) {
+				BITS_SET(qio->sub, i);
+			}
+			qio->suball = false;
+		}
+		BITS_CLR(qio->sub, idx);
+		if (idx / 64U < qio->npnd) {
+			/* and don't push what's still pending */
+			BITS_CLR(qio->pnd, idx);
+		}
+		return 0;
+	} else if (bits_fit(&qio->pnd, &qio->npnd, idx) < 0) {
+		return -1;
+	}
+	BITS_SET(qio->sub, idx);
+	BITS_SET(qio->pnd, idx);
+	return 0;
+}
+
+static int
+ws_cmd(ev_io_i_t qio, const char *s, size_t z)
+{
+/* commands look like `sub 1 2 3' or `unsub 2', no indices means all */
+	const char *const ep = s + z;
+	bool any = false;
+	bool on;
+
+	if (z >= 5U && !memcmp(s, "unsub", 5U)) {
+		on = false;
+		s += 5U;
+	} else if (z >= 3U && !memcmp(s, "sub", 3U)) {
+		on = true;
+		s += 3U;
 	} else {
-		/* uh oh, mega request, wtf? */
-		buf[sizeof(buf) - 1] = '\0';
+		/* ignore */
+		return 0;
 	}
+	while (s < ep) {
+		unsigned int idx = 0U;
 
-	ws = websvc(buf, (size_t)nrd);
-	wr = web(ws);
+		for (; s < ep && !isdigit(*s); s++);
+		if (s >= ep) {
+			break;
+		}
+		for (; s < ep && isdigit(*s) && idx < 65536U; s++) {
+			idx = idx * 10U + (*s - '0');
+		}
+		if (idx < WEBSVC_ALL && ws_sub(qio, idx, on) < 0) {
+			return -1;
+		}
+		any = true;
+	}
+	if (!any) {
+		return ws_sub(qio, WEBSVC_ALL, on);
+	}
+	return 0;
+}
+
+static int
+ws_frame(ev_io_i_t qio, const struct ws_frame_s *f)
+{
+	char hdr[WS_HDR_MAXZ];
+	struct iovec v[2] = {{.iov_base = hdr}, {.iov_base = f->pl}};
+	struct webrsp_s wr = {.iov = v, .niov = countof(v)};
+
+	switch (f->op) {
+	case WS_OP_TEXT:
+		return ws_cmd(qio, f->pl, f->plz);
+	case WS_OP_PING:
+		v[0].iov_len = ws_frame_hdr(hdr, WS_OP_PONG, f->plz);
+		v[1].iov_len = f->plz;
+		break;
+	case WS_OP_CLOSE:
+		/* echo the status code, if any, then hang up */
+		v[1].iov_len = f->plz >= 2U ? 2U : 0U;
+		v[0].iov_len = ws_frame_hdr(hdr, WS_OP_CLOSE, v[1].iov_len);
+		qio->clo = true;
+		break;
+	default:
+		return 0;
+	}
+	wr.len = v[0].iov_len + v[1].iov_len;
+	return qio_send(qio, &wr);
+}
+
+static int
+ws_upgrade(ev_io_i_t qio, struct websvc_s ws, const char *req)
+{
+/* turn QIO into a subscriber, return 1 if REQ is no proper handshake */
+	char hs[256];
+	struct iovec v[1] = {{.iov_base = hs}};
+	struct webrsp_s wr = {.iov = v, .niov = countof(v)};
+	ssize_t hz;
+
+	if ((hz = ws_accept(hs, sizeof(hs), req)) < 0) {
+		return 1;
+	}
+	v->iov_len = wr.len = hz;
+	if (qio_send(qio, &wr) < 0) {
+		return -1;
+	}
+	qio->ws = true;
+	gq_push_tail(wsq, (gq_item_t)qio);
+	return ws_sub(qio, ws.websock.idx, true);
+}
 
-	/* send header */
-	nwr = 0;
-	for (ssize_t tmp;
-	     (tmp = send(w->fd, wr.hdr + nwr, wr.hdz - nwr, 0)) > 0 &&
-		     (nwr += tmp) < wr.hdz;);
+static int
+ws_push(ev_io_i_t qio)
+{
+/* collect dirty instruments, push them unless QIO is still busy, so
+ * slow subscribers get to see the latest quotes only */
+	struct webrsp_s wr;
+	bool any = false;
+	int rc;
 
-	/* send beef */
-	nwr = 0;
-	for (ssize_t tmp;
-	     (tmp = send(w->fd, wr.cnt + nwr, wr.cnz - nwr, 0)) > 0 &&
-		     (nwr += tmp) < wr.cnz;);
+	if (nws_dirty > 0U &&
+	    bits_fit(&qio->pnd, &qio->npnd, nws_dirty * 64U - 1U) < 0) {
+		return -1;
+	}
+	for (size_t i = 0; i < nws_dirty; i++) {
+		uint64_t d = ws_dirty[i];
 
-	/* free resources */
+		if (!qio->suball) {
+			d &= i < qio->nsub ? qio->sub[i] : 0U;
+		}
+		qio->pnd[i] |= d;
+	}
+	if (qio->rpo < qio->rpz) {
+		/* busy */
+		return 0;
+	}
+	for (size_t i = 0; i < qio->npnd && !any; i++) {
+		any = qio->pnd[i] != 0U;
+	}
+	if (!any) {
+		return 0;
+	}
+	wr = web_push_quot(qio->pnd, qio->npnd);
+	rc = qio_send(qio, &wr);
 	free_webrsp(wr);
+	memset(qio->pnd, 0, qio->npnd * sizeof(*qio->pnd));
+	return rc;
+}
+
+static void
+ws_flush(EV_P)
+{
+	for (gq_item_t i = wsq->i1st, nxt; i != GQ_NULL_ITEM; i = nxt) {
+		ev_io_i_t qio = (void*)i;
+
+		nxt = i->next;
+		if (ws_push(qio) < 0) {
+			ev_qio_shut(EV_A_ qio->w);
+		} else {
+			qio_want(EV_A_ qio);
+		}
+	}
+	if (nws_dirty > 0U) {
+		memset(ws_dirty, 0, nws_dirty * sizeof(*ws_dirty));
+	}
+	return;
+}
+
+static int
+qio_serve(ev_io_i_t qio, bool eof)
+{
+/* answer pipelined requests in QIO's request buffer, stop as soon as
+ * a reply couldn't be sent in full */
+	size_t o = 0U;
+
+	while (!qio->clo && qio->rpo >= qio->rpz && o < qio->rqz) {
+		struct websvc_s ws;
+		struct webrsp_s wr;
+		int rc;
+
+		if (qio->ws) {
+			/* subscribers talk in frames */
+			struct ws_frame_s f;
+			ssize_t fz;
+
+			if ((fz = ws_frame_dec(&f, qio->req + o, qio->rqz - o)) < 0) {
+				return -1;
+			} else if (fz == 0) {
+				break;
+			} else if (ws_frame(qio, &f) < 0) {
+				return -1;
+			}
+			o += fz;
+			continue;
+		}
+
+		qio->req[qio->rqz] = '\0';
+		ws = websvc(qio->req + o, qio->rqz - o);
+		if (ws.len == 0U) {
+			if (!eof) {
+				/* wait for the rest of it */
+				break;
+			}
+			/* be lenient with half-closing clients */
+			ws.len = qio->rqz - o;
+			ws.clo = true;
+		} else if (ws.ty == WEBSVC_F_WEBSOCK &&
+			   (rc = ws_upgrade(qio, ws, qio->req + o)) <= 0) {
+			if (rc < 0) {
+				return -1;
+			}
+			o += ws.len;
+			continue;
+		}
+		wr = web(ws);
+
+		/* send header and beef, keep what's left for later */
+		rc = qio_send(qio, &wr);
+
+		/* free resources */
+		free_webrsp(wr);
+		if (rc < 0) {
+			return -1;
+		}
+		o += ws.len;
+		qio->clo = ws.clo;
+	}
+	/* shift unanswered requests to the front */
+	memmove(qio->req, qio->req + o, qio->rqz - o);
+	qio->rqz -= o;
+	return 0;
+}
+
+static void
+dccp_data_cb(EV_P_ ev_io *w, int re)
+{
+	ev_io_i_t qio = w->data;
+	bool eof = false;
+
+	if (re & EV_WRITE) {
+		/* flush what's pending */
+		ssize_t nwr;
+
+		nwr = write(w->fd, qio->rpl + qio->rpo, qio->rpz - qio->rpo);
+		if (nwr < 0 && (errno == EAGAIN || errno == EINTR)) {
+			return;
+		} else if (nwr < 0) {
+			goto clo;
+		} else if ((qio->rpo += nwr) < qio->rpz) {
+			goto out;
+		}
+		qio->rpo = qio->rpz = 0U;
+	}
+	if (re & EV_READ) {
+		ssize_t nrd;
+
+		if (qio->rqz + 1U >= qio->rqsz) {
+			/* make room, keep a byte for the terminator */
+			size_t nu = qio->rqsz ? qio->rqsz * 2U : 4096U;
+			char *tmp;
+
+			if (nu > QIO_MAXREQ) {
+				/* uh oh, mega request, wtf? */
+				goto clo;
+			} else if ((tmp = realloc(qio->req, nu)) == NULL) {
+				goto clo;
+			}
+			qio->req = tmp;
+			qio->rqsz = nu;
+		}
+		nrd = read(w->fd, qio->req + qio->rqz, qio->rqsz - qio->rqz - 1U);
+		if (nrd < 0 && (errno == EAGAIN || errno == EINTR)) {
+			return;
+		} else if (nrd < 0) {
+			goto clo;
+		} else if (nrd == 0) {
+			eof = true;
+		}
+		qio->rqz += nrd;
+	}
+
+	/* answer whatever's complete */
+	if (qio_serve(qio, eof) < 0) {
+		goto clo;
+	} else if (qio->rpo >= qio->rpz && (qio->clo || eof)) {
+		goto clo;
+	}
+	qio_want(EV_A_ qio);
+out:
+	if (LIKELY(!qio->ws)) {
+		ev_timer_again(EV_A_ qio->tmo);
+	} else {
+		/* subscribers may stay silent for good */
+		ev_timer_stop(EV_A_ qio->tmo);
+	}
+	return;
 clo:
 	ev_qio_shut(EV_A_ w);
 	return;
 }
 
+static void
+dccp_tmo_cb(EV_P_ ev_timer *w, int UNUSED(re))
+{
+	ev_io_i_t qio = w->data;
+
+	UMQD_DEBUG("idle connection on %d\n", qio->w->fd);
+	ev_qio_shut(EV_A_ qio->w);
+	return;
+}
+
 static void
 dccp_cb(EV_P_ ev_io *w, int UNUSED(re))
 {
@@ -1272,10 +2231,16 @@ dccp_cb(EV_P_ ev_io *w, int UNUSED(re))
 		return;
 	}
 
+	/* connections may be kept alive, so don't block on them */
+	setsock_nonblock(s);
+
 	qio = make_io();
 	ev_io_init(qio->w, dccp_data_cb, s, EV_READ);
 	qio->w->data = qio;
 	ev_io_start(EV_A_ qio->w);
+	ev_timer_init(qio->tmo, dccp_tmo_cb, 0., QIO_TIMEOUT);
+	qio->tmo->data = qio;
+	ev_timer_again(EV_A_ qio->tmo);
 	return;
 }
 
@@ -1284,6 +2249,8 @@ prep_cb(EV_P_ ev_prepare *UNUSED(w), int UNUSED(revents))
 {
 	/* check the uri fetch queue */
 	check_urifq(EV_A);
+	/* push quote updates to websocket subscribers */
+	ws_flush(EV_A);
 	return;
 }
 
@@ -1303,14 +2270,14 @@ sigpipe_cb(EV_P_ ev_signal *UNUSED(w), int UNUSED(revents))
 static void
 sighup_cb(EV_P_ ev_signal *UNUSED(w), int UNUSED(revents))
 {
-	rotate_outfile(EV_A);
+	rotate_outfile();
 	return;
 }
 
 static void
 midnight_cb(EV_P_ ev_periodic *UNUSED(w), int UNUSED(r))
 {
-	rotate_outfile(EV_A);
+	rotate_outfile();
 	return;
 }
 
@@ -1451,6 +2418,8 @@ main(int argc, char *argv[])
 		ud_sock_t s;
 
 		if (LIKELY((s = ud_socket(opt)) != NULL)) {
+			/* give bursts some room in the kernel */
+			setsock_rcvbuf(s->fd, BEEF_RCVBUF);
 			ev_io_init(beef + i + 1, mon_beef_cb, s->fd, EV_READ);
 			ev_io_start(EV_A_ beef + i + 1);
 		}
@@ -1543,9 +2512,30 @@ main(int argc, char *argv[])
 	ev_prepare_init(prp, prep_cb);
 	ev_prepare_start(EV_A_ prp);
 
+	/* secdef resolver */
+	init_rslv(EV_A);
+
+	/* writer thread */
+	if (argi->writer_thread_flag && init_wrr() < 0) {
+		fputs("cannot start writer thread, dumping inline\n", logerr);
+	}
+
+	/* shared memory export */
+	if (argi->shm_arg && quod_shm_init(argi->shm_arg) < 0) {
+		fprintf(logerr, "cannot export quote cache to %s: %s\n",
+			argi->shm_arg, strerror(errno));
+	}
+
 	/* now wait for events to arrive */
 	ev_loop(EV_A_ 0);
 
+	/* stop resolving */
+	fini_rslv(EV_A);
+	/* and writing */
+	fini_wrr();
+	/* and exporting */
+	quod_shm_fini();
+
 past_loop:
 	/* close the file, might take a while due to sorting */
 	if (uctx) {
@@ -1556,8 +2546,13 @@ past_loop:
 	}
 	/* print name and stats */
 	fprintf(logerr, "dumped %zu ticks, %zu ignored\n", u_nt, ign);
+	fprintf(logerr, "cli index: %zu lookups, %zu probes, "
+		"max probe %zu, %zu rehashes\n",
+		chst.nlkup, chst.nprob, chst.maxprob, chst.nrehash);
 	fputs(u_fn, stdout);
 	fputc('\n', stdout);
+	/* rotated files might still be being written */
+	ute_close_bg_wait();
 
 past_ute:
 	/* detaching beef channels */
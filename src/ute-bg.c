@@ -0,0 +1,141 @@
+/*** ute-bg.c -- closing ute files in the background
+ *
+ * Copyright (C) 2012-2013 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of unsermarkt.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "ute-bg.h"
+#include "nifty.h"
+
+struct bgclo_s {
+	utectx_t ctx;
+	char fn[];
+};
+
+/* number of closes in flight */
+static size_t nbg = 0U;
+static pthread_mutex_t bg_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bg_cnd = PTHREAD_COND_INITIALIZER;
+
+
+static void
+clo(utectx_t ctx, const char *fn)
+{
+	/* this might take a while due to sorting */
+	ute_close(ctx);
+	/* let people know the file's ready */
+	fputs(fn, stdout);
+	fputc('\n', stdout);
+	fflush(stdout);
+	return;
+}
+
+static void*
+bgclo(void *clo_)
+{
+	struct bgclo_s *b = clo_;
+
+	clo(b->ctx, b->fn);
+	free(b);
+
+	pthread_mutex_lock(&bg_mtx);
+	if (--nbg == 0U) {
+		pthread_cond_broadcast(&bg_cnd);
+	}
+	pthread_mutex_unlock(&bg_mtx);
+	return NULL;
+}
+
+
+int
+ute_close_bg(utectx_t ctx)
+{
+	const char *fn = ute_fn(ctx);
+	size_t fz = strlen(fn);
+	struct bgclo_s *b;
+	pthread_attr_t attr[1];
+	pthread_t thr;
+	int rc = -1;
+
+	if (UNLIKELY((b = malloc(sizeof(*b) + fz + 1U)) == NULL)) {
+		goto sync;
+	}
+	b->ctx = ctx;
+	memcpy(b->fn, fn, fz + 1U);
+
+	pthread_mutex_lock(&bg_mtx);
+	nbg++;
+	pthread_attr_init(attr);
+	pthread_attr_setdetachstate(attr, PTHREAD_CREATE_DETACHED);
+	if ((rc = pthread_create(&thr, attr, bgclo, b)) != 0) {
+		nbg--;
+		free(b);
+		rc = -1;
+	}
+	pthread_attr_destroy(attr);
+	pthread_mutex_unlock(&bg_mtx);
+
+	if (LIKELY(rc == 0)) {
+		return 0;
+	}
+sync:
+	/* do it in the foreground then, ute_close() frees FN with CTX */
+	{
+		char fnb[fz + 1U];
+
+		memcpy(fnb, fn, fz + 1U);
+		clo(ctx, fnb);
+	}
+	return -1;
+}
+
+void
+ute_close_bg_wait(void)
+{
+	pthread_mutex_lock(&bg_mtx);
+	while (nbg > 0U) {
+		pthread_cond_wait(&bg_cnd, &bg_mtx);
+	}
+	pthread_mutex_unlock(&bg_mtx);
+	return;
+}
+
+/* ute-bg.c ends here */
@@ -41,7 +41,12 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <strings.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <time.h>
 #if defined HAVE_LIBFIXC_FIX_H
 # include <libfixc/fix.h>
@@ -65,6 +70,8 @@
 # define WEB_ASP_SECDEF
 # include "um-quod.h"
 # include "quod-cache.h"
+# include "quod-bin.h"
+# include "htws.h"
 #endif	/* WEB_ASP_QUOTREQ */
 #if defined WEB_ASP_REQFORPOSS
 # include "um-apfd.h"
@@ -79,6 +86,49 @@
 # define WEB_DEBUG(args...)
 #endif	/* DEBUG_FLAG */
 
+#if !defined IOV_MAX
+# define IOV_MAX	(1024)
+#endif	/* !IOV_MAX */
+
+
+/* response scatter-gather list, iov[0] is reserved for the header */
+static struct iovec *iov = NULL;
+static size_t niov = 0UL;
+static size_t ziov = 0UL;
+/* set when the list couldn't grow, the response is incomplete then */
+static bool iov_oom = false;
+
+static void
+iov_reset(void)
+{
+	niov = 0UL;
+	iov_oom = false;
+	return;
+}
+
+static int
+iov_add(const void *p, size_t z)
+{
+	if (UNLIKELY(z == 0UL)) {
+		return 0;
+	} else if (UNLIKELY(niov >= ziov)) {
+		size_t nz = ziov ? ziov * 2U : 64U;
+		struct iovec *tmp;
+
+		if ((tmp = realloc(iov, nz * sizeof(*iov))) == NULL) {
+			/* keep the old list, but remember the loss */
+			iov_oom = true;
+			return -1;
+		}
+		iov = tmp;
+		ziov = nz;
+	}
+	iov[niov].iov_base = (void*)(uintptr_t)p;
+	iov[niov].iov_len = z;
+	niov++;
+	return 0;
+}
+
 
 /* helpers */
 static uint16_t
@@ -91,7 +141,7 @@ __find_idx(const char *str)
 		}
 		return 0;
 	}
-#define MASS_QUOT	(0xffff)
+#define MASS_QUOT	(WEBSVC_ALL)
 	return MASS_QUOT;
 }
 
@@ -120,6 +170,23 @@ bugger:
 	return 0UL;
 }
 
+static const char*
+__find_hdr(const char *hdr, size_t hdz, const char *key, size_t kz)
+{
+/* find header field KEY (case-insensitively) in HDR, return its value */
+	for (const char *p = hdr, *const ep = hdr + hdz, *eol; p < ep;
+	     p = eol + 1) {
+		if ((eol = memchr(p, '\n', ep - p)) == NULL) {
+			eol = ep;
+		}
+		if ((size_t)(eol - p) > kz && strncasecmp(p, key, kz) == 0) {
+			for (p += kz; p < eol && (*p == ' ' || *p == '\t'); p++);
+			return p;
+		}
+	}
+	return NULL;
+}
+
 /* date and time funs, could use libdut from dateutils */
 static int
 __leapp(unsigned int y)
@@ -222,7 +289,7 @@ ffff_strfdtu(char *restrict buf, size_t bsz, time_t sec, unsigned int usec)
 
 /* unknown service */
 static size_t
-websvc_unk(char **restrict tgt, size_t tsz, struct websvc_s UNUSED(sd))
+websvc_unk(struct webrsp_s *UNUSED(tgt), struct websvc_s UNUSED(sd))
 {
 	static const char rsp[] = "\
 <!DOCTYPE html>\n\
@@ -247,13 +314,23 @@ websvc_unk(char **restrict tgt, size_t tsz, struct websvc_s UNUSED(sd))
   </body>\n\
 </html>\n\
 ";
-	if (tsz < sizeof(rsp)) {
-		return 0;
-	}
-	memcpy(*tgt, rsp, sizeof(rsp));
+	iov_add(rsp, sizeof(rsp) - 1);
 	return sizeof(rsp) - 1;
 }
 
+#if defined HAVE_LIBFIXC_FIX_H
+static size_t
+rndr_add(struct webrsp_s *restrict tgt, struct fixc_rndr_s r)
+{
+/* put the rendered message into the response, it's freed later on */
+	tgt->cnt = r.str;
+	tgt->cnz = r.len;
+	iov_add(r.str, r.len);
+	return r.len;
+}
+#endif	/* HAVE_LIBFIXC_FIX_H */
+
+
 
 /* secdef service */
 #if defined WEB_ASP_SECDEF
@@ -290,7 +367,7 @@ __secdef1(fixc_msg_t msg, uint16_t idx)
 }
 
 static size_t
-websvc_secdef(char **restrict tgt, size_t UNUSED(tsz), struct websvc_s sd)
+websvc_secdef(struct webrsp_s *restrict tgt, struct websvc_s sd)
 {
 	size_t nsy = ute_nsyms(uctx);
 	fixc_msg_t msg;
@@ -320,8 +397,7 @@ websvc_secdef(char **restrict tgt, size_t UNUSED(tsz), struct websvc_s sd)
 	r = fixc_render_fixml_rndr(msg);
 	free_fixc(msg);
 	/* get ready for the harvest */
-	*tgt = r.str;
-	return r.len;
+	return rndr_add(tgt, r);
 }
 
 # else  /* !HAVE_LIBFIXC_FIX_H */
@@ -336,24 +412,19 @@ static const char fixml_batch_pre[] = "<Batch>\n";
 static const char fixml_batch_post[] = "</Batch>\n";
 
 static size_t
-__secdef1(char *restrict tgt, size_t tsz, uint16_t idx)
+__secdef1(uint16_t idx)
 {
 	size_t res = 0UL;
 
-	if (quod_cache[idx - 1].sd && tsz) {
+	if (quod_cache[idx - 1].sd) {
 		res = quod_cache[idx - 1].sdsz;
-
-		if (tsz < (size_t)res) {
-			res = tsz - 1;
-		}
-		memcpy(tgt, quod_cache[idx - 1].sd, res);
-		tgt[res] = '\0';
+		iov_add(quod_cache[idx - 1].sd, res);
 	}
 	return res;
 }
 
 static size_t
-websvc_secdef(char **restrict tgt, size_t tsz, struct websvc_s sd)
+websvc_secdef(struct webrsp_s *UNUSED(tgt), struct websvc_s sd)
 {
 	size_t idx = 0;
 	size_t nsy = ute_nsyms(uctx);
@@ -364,25 +435,25 @@ websvc_secdef(char **restrict tgt, size_t tsz, struct websvc_s sd)
 		return 0;
 	}
 
-	/* copy pre */
-	memcpy(*tgt + idx, fixml_pre, sizeof(fixml_pre));
+	/* pre */
+	iov_add(fixml_pre, sizeof(fixml_pre) - 1);
 	idx += sizeof(fixml_pre) - 1;
 
 	if (sd.secdef.idx <= nsy) {
-		idx += __secdef1(*tgt + idx, tsz - idx, sd.secdef.idx);
+		idx += __secdef1(sd.secdef.idx);
 	} else if (sd.quotreq.idx == MASS_QUOT) {
-		memcpy(*tgt + idx, fixml_batch_pre, sizeof(fixml_batch_pre));
+		iov_add(fixml_batch_pre, sizeof(fixml_batch_pre) - 1);
 		idx += sizeof(fixml_batch_pre) - 1;
 		/* loop over instruments */
 		for (size_t i = 1; i <= nsy; i++) {
-			idx += __secdef1(*tgt + idx, tsz - idx, i);
+			idx += __secdef1(i);
 		}
-		memcpy(*tgt + idx, fixml_batch_post, sizeof(fixml_batch_post));
+		iov_add(fixml_batch_post, sizeof(fixml_batch_post) - 1);
 		idx += sizeof(fixml_batch_post) - 1;
 	}
 
-	/* copy post */
-	memcpy(*tgt + idx, fixml_post, sizeof(fixml_post));
+	/* post */
+	iov_add(fixml_post, sizeof(fixml_post) - 1);
 	idx += sizeof(fixml_post) - 1;
 	return idx;
 }
@@ -498,7 +569,7 @@ __quotreq1(fixc_msg_t msg, uint16_t idx, struct timeval now)
 }
 
 static size_t
-websvc_quotreq(char **restrict tgt, size_t UNUSED(tsz), struct websvc_s sd)
+websvc_quotreq(struct webrsp_s *restrict tgt, struct websvc_s sd)
 {
 	size_t nsy = ute_nsyms(uctx);
 	struct timeval now[1];
@@ -517,7 +588,7 @@ websvc_quotreq(char **restrict tgt, size_t UNUSED(tsz), struct websvc_s sd)
 	/* start a fix msg for that */
 	msg = make_fixc_msg((fixc_msgt_t)FIXC_MSGT_UNK);
 
-	if (sd.quotreq.idx < nsy) {
+	if (sd.quotreq.idx <= nsy) {
 		__quotreq1(msg, sd.quotreq.idx, *now);
 	} else if (sd.quotreq.idx == MASS_QUOT) {
 		/* loop over instruments */
@@ -531,25 +602,70 @@ websvc_quotreq(char **restrict tgt, size_t UNUSED(tsz), struct websvc_s sd)
 	r = fixc_render_fixml_rndr(msg);
 	free_fixc(msg);
 	/* get ready for the harvest */
-	*tgt = r.str;
-	return r.len;
+	return rndr_add(tgt, r);
+}
+
+struct webrsp_s
+web_push_quot(const uint64_t *set, size_t nset)
+{
+	static char hdr[WS_HDR_MAXZ];
+	size_t nsy = ute_nsyms(uctx);
+	struct webrsp_s res = {NULL};
+	struct timeval now[1];
+	fixc_msg_t msg;
+	size_t z;
+
+	/* get current time */
+	gettimeofday(now, NULL);
+
+	/* start a fix msg for that */
+	msg = make_fixc_msg((fixc_msgt_t)FIXC_MSGT_BATCH);
+
+	for (size_t i = 0; i < nset; i++) {
+		for (uint64_t b = set[i]; b; b &= b - 1U) {
+			size_t idx = i * 64U + __builtin_ctzll(b);
+
+			if (idx > 0U && idx <= nsy) {
+				__quotreq1(msg, idx, *now);
+			}
+		}
+	}
+
+	/* frame header goes first */
+	iov_reset();
+	iov_add(hdr, sizeof(hdr));
+	z = rndr_add(&res, fixc_render_fixml_rndr(msg));
+	free_fixc(msg);
+
+	if (UNLIKELY(iov_oom)) {
+		/* send_webrsp() will refuse this */
+		return res;
+	}
+	iov->iov_len = ws_frame_hdr(hdr, WS_OP_TEXT, z);
+	res.iov = iov;
+	res.niov = niov;
+	res.len = iov->iov_len + z;
+	return res;
 }
 
 # else  /* !HAVE_LIBFIXC_FIX_H */
-static size_t
-__quotreq1(char *restrict tgt, size_t tsz, uint16_t idx, struct timeval now)
+static void
+__quotrndr(uint16_t idx)
 {
-	static char eoquot[] = "</Quot>\n";
+/* render the <Quot> element of IDX into its cache cell, the
+ * ValidUntilTm value is left out and spliced in at QUOTO later */
+	static const char eoquot[] = "\">";
+	static const char eoquot_post[] = "</Quot>\n";
 	static size_t qid = 0;
 	static char bp[16], ap[16], bq[16], aq[16];
-	static char vtm[32];
 	static char txn[32];
-	static struct timeval now_cch;
-	const char *sym = ute_idx2sym(uctx, idx);
+	static char hd[256];
+	const char *sym = NULL;
 	const_sl1t_t b = quod_cache[idx - 1].bid;
 	const_sl1t_t a = quod_cache[idx - 1].ask;
 	const char *instrmt = quod_cache[idx - 1].instrmt;
 	size_t instrmtsz = quod_cache[idx - 1].instrmtsz;
+	size_t z;
 	int len;
 
 	/* find the more recent quote out of bid and ask */
@@ -564,7 +680,7 @@ __quotreq1(char *restrict tgt, size_t tsz, uint16_t idx, struct timeval now)
 			bms = ams;
 		}
 		if (UNLIKELY(bs == 0)) {
-			return 0;
+			return;
 		}
 
 		ffff_strfdtu(txn, sizeof(txn), bs, bms * 1000);
@@ -575,46 +691,108 @@ __quotreq1(char *restrict tgt, size_t tsz, uint16_t idx, struct timeval now)
 	ffff_m30_s(ap, (m30_t)a->pri);
 	ffff_m30_s(aq, (m30_t)a->qty);
 
-	if (now_cch.tv_sec != now.tv_sec) {
-		ffff_strfdtu(vtm, sizeof(vtm), now.tv_sec, now.tv_usec);
-		now_cch = now;
-	}
-
 	len = snprintf(
-		tgt, tsz, "\
+		hd, sizeof(hd), "\
   <Quot QID=\"%zu\" \
 BidPx=\"%s\" OfrPx=\"%s\" BidSz=\"%s\" OfrSz=\"%s\" \
-TxnTm=\"%s\" ValidUntilTm=\"%s\">",
-		++qid, bp, ap, bq, aq, txn, vtm);
+TxnTm=\"%s\" ValidUntilTm=\"",
+		++qid, bp, ap, bq, aq, txn);
+	if (UNLIKELY(len < 0 || (size_t)len >= sizeof(hd))) {
+		return;
+	}
 
 	/* see if there's an instrm block */
-	if (instrmt) {
-		if (instrmtsz > tsz - len) {
-			instrmtsz = tsz - len;
-		}
-		memcpy(tgt + len, instrmt, instrmtsz);
-		len += instrmtsz;
-	} else {
-		len += snprintf(
-			tgt + len, tsz - len, "\
+	if (instrmt == NULL) {
+		static char ins[256];
+
+		sym = ute_idx2sym(uctx, idx);
+		instrmtsz = snprintf(
+			ins, sizeof(ins), "\
 <Instrmt Sym=\"%s\" ID=\"%hu\" Src=\"100\"/>",
 			sym, idx);
+		if (UNLIKELY(instrmtsz >= sizeof(ins))) {
+			instrmtsz = sizeof(ins) - 1;
+		}
+		instrmt = ins;
+	}
+
+	/* make sure there's enough room in the cell */
+	z = len + sizeof(eoquot) - 1 + instrmtsz + sizeof(eoquot_post) - 1;
+	if (z > quod_cache[idx - 1].quotsz) {
+		char *tmp;
+
+		if ((tmp = realloc(quod_cache[idx - 1].quot, z)) == NULL) {
+			return;
+		}
+		quod_cache[idx - 1].quot = tmp;
+		quod_cache[idx - 1].quotsz = z;
 	}
 
-	/* close the Quot tag */
-	if (sizeof(eoquot) < tsz - len) {
-		memcpy(tgt + len, eoquot, sizeof(eoquot));
-		len += sizeof(eoquot) - 1;
+	/* bang it all */
+	{
+		char *q = quod_cache[idx - 1].quot;
+
+		memcpy(q, hd, len);
+		q += len;
+		memcpy(q, eoquot, sizeof(eoquot) - 1);
+		q += sizeof(eoquot) - 1;
+		memcpy(q, instrmt, instrmtsz);
+		q += instrmtsz;
+		memcpy(q, eoquot_post, sizeof(eoquot_post) - 1);
 	}
-	return len;
+	quod_cache[idx - 1].quoto = len;
+	quod_cache[idx - 1].quotz = z;
+	return;
 }
 
 static size_t
-websvc_quotreq(char **restrict tgt, size_t tsz, struct websvc_s sd)
+__quotreq1(uint16_t idx, const char *vtm, size_t vtz)
+{
+	size_t o;
+	size_t z;
+
+	if (quod_cache[idx - 1].quotz == 0UL) {
+		/* invalidated, or never rendered */
+		__quotrndr(idx);
+	}
+	if ((z = quod_cache[idx - 1].quotz) == 0UL) {
+		/* still nothing */
+		return 0UL;
+	}
+
+	/* head, valid-until time stamp, tail */
+	o = quod_cache[idx - 1].quoto;
+	iov_add(quod_cache[idx - 1].quot, o);
+	iov_add(vtm, vtz);
+	iov_add(quod_cache[idx - 1].quot + o, z - o);
+	return z + vtz;
+}
+
+static const char*
+__valid_until(size_t *restrict vtz)
+{
+/* current time stamp for ValidUntilTm, rendered once a second */
+	static char vtm[32];
+	static size_t vtmz;
+	static struct timeval now_cch;
+	struct timeval now[1];
+
+	gettimeofday(now, NULL);
+	if (now_cch.tv_sec != now->tv_sec) {
+		vtmz = ffff_strfdtu(vtm, sizeof(vtm), now->tv_sec, now->tv_usec);
+		now_cch = *now;
+	}
+	*vtz = vtmz;
+	return vtm;
+}
+
+static size_t
+websvc_quotreq(struct webrsp_s *UNUSED(tgt), struct websvc_s sd)
 {
 	size_t idx = 0;
 	size_t nsy = ute_nsyms(uctx);
-	struct timeval now[1];
+	const char *vtm;
+	size_t vtz;
 
 	WEB_DEBUG("printing quotreq idx %hu\n", sd.quotreq.idx);
 
@@ -623,31 +801,152 @@ websvc_quotreq(char **restrict tgt, size_t tsz, struct websvc_s sd)
 	}
 
 	/* get current time */
-	gettimeofday(now, NULL);
+	vtm = __valid_until(&vtz);
 
-	/* copy pre */
-	memcpy(*tgt + idx, fixml_pre, sizeof(fixml_pre));
+	/* pre */
+	iov_add(fixml_pre, sizeof(fixml_pre) - 1);
 	idx += sizeof(fixml_pre) - 1;
 
-	if (sd.quotreq.idx < nsy) {
-		idx += __quotreq1(*tgt + idx, tsz - idx, sd.quotreq.idx, *now);
+	if (sd.quotreq.idx <= nsy) {
+		idx += __quotreq1(sd.quotreq.idx, vtm, vtz);
 	} else if (sd.quotreq.idx == MASS_QUOT) {
-		memcpy(*tgt + idx, fixml_batch_pre, sizeof(fixml_batch_pre));
+		iov_add(fixml_batch_pre, sizeof(fixml_batch_pre) - 1);
 		idx += sizeof(fixml_batch_pre) - 1;
 		/* loop over instruments */
 		for (size_t i = 1; i <= nsy; i++) {
-			idx += __quotreq1(*tgt + idx, tsz - idx, i, *now);
+			idx += __quotreq1(i, vtm, vtz);
 		}
-		memcpy(*tgt + idx, fixml_batch_post, sizeof(fixml_batch_post));
+		iov_add(fixml_batch_post, sizeof(fixml_batch_post) - 1);
 		idx += sizeof(fixml_batch_post) - 1;
 	}
 
-	/* copy post */
-	memcpy(*tgt + idx, fixml_post, sizeof(fixml_post));
+	/* post */
+	iov_add(fixml_post, sizeof(fixml_post) - 1);
 	idx += sizeof(fixml_post) - 1;
 	return idx;
 }
+
+struct webrsp_s
+web_push_quot(const uint64_t *set, size_t nset)
+{
+	static char hdr[WS_HDR_MAXZ];
+	size_t nsy = ute_nsyms(uctx);
+	struct webrsp_s res = {NULL};
+	const char *vtm;
+	size_t vtz;
+	size_t z = 0UL;
+
+	/* get current time */
+	vtm = __valid_until(&vtz);
+
+	/* frame header goes first */
+	iov_reset();
+	iov_add(hdr, sizeof(hdr));
+
+	iov_add(fixml_pre, sizeof(fixml_pre) - 1);
+	z += sizeof(fixml_pre) - 1;
+	iov_add(fixml_batch_pre, sizeof(fixml_batch_pre) - 1);
+	z += sizeof(fixml_batch_pre) - 1;
+	for (size_t i = 0; i < nset; i++) {
+		for (uint64_t b = set[i]; b; b &= b - 1U) {
+			size_t idx = i * 64U + __builtin_ctzll(b);
+
+			if (idx > 0U && idx <= nsy) {
+				z += __quotreq1(idx, vtm, vtz);
+			}
+		}
+	}
+	iov_add(fixml_batch_post, sizeof(fixml_batch_post) - 1);
+	z += sizeof(fixml_batch_post) - 1;
+	iov_add(fixml_post, sizeof(fixml_post) - 1);
+	z += sizeof(fixml_post) - 1;
+
+	if (UNLIKELY(iov_oom)) {
+		/* send_webrsp() will refuse this */
+		return res;
+	}
+	iov->iov_len = ws_frame_hdr(hdr, WS_OP_TEXT, z);
+	res.iov = iov;
+	res.niov = niov;
+	res.len = iov->iov_len + z;
+	return res;
+}
 # endif	/* HAVE_LIBFIXC_FIX_H */
+
+/* binary quote snapshots, see quod-bin.h */
+static size_t
+websvc_quotbin(struct webrsp_s *UNUSED(tgt), struct websvc_s sd)
+{
+	static struct quod_bin_hdr_s hdr = {
+		.magic = QUOD_BIN_MAGIC,
+		.bom = QUOD_BIN_BOM,
+		.recz = sizeof(struct quod_bin_rec_s),
+	};
+	static struct quod_bin_rec_s *recs;
+	static size_t nrecs;
+	static char *strs;
+	static size_t strsz;
+	size_t nsy = ute_nsyms(uctx);
+	size_t beg, end;
+	size_t strz = 0UL;
+
+	WEB_DEBUG("printing quotbin idx %hu\n", sd.quotbin.idx);
+
+	if (sd.quotbin.idx && sd.quotbin.idx <= nsy) {
+		beg = end = sd.quotbin.idx;
+	} else if (sd.quotbin.idx == MASS_QUOT) {
+		beg = 1U;
+		end = nsy;
+	} else {
+		beg = 1U;
+		end = 0U;
+	}
+
+	if (end - beg + 1U > nrecs) {
+		size_t nu = ((end - beg + 1U) + 255U) & ~255U;
+		void *tmp;
+
+		if ((tmp = realloc(recs, nu * sizeof(*recs))) == NULL) {
+			return 0UL;
+		}
+		recs = tmp;
+		nrecs = nu;
+	}
+
+	for (size_t i = beg, j = 0U; i <= end; i++, j++) {
+		recs[j].idx = (uint16_t)i;
+		recs[j].flags = 0U;
+		recs[j].symo = 0U;
+		recs[j].bid = *quod_cache[i - 1].bid;
+		recs[j].ask = *quod_cache[i - 1].ask;
+
+		if (sd.quotbin.syms) {
+			const char *sym = ute_idx2sym(uctx, i) ?: "";
+			size_t sz = strlen(sym) + 1U;
+
+			if (strz + sz > strsz) {
+				size_t nu = (strz + sz + 4095U) & ~4095U;
+				char *tmp;
+
+				if ((tmp = realloc(strs, nu)) == NULL) {
+					return 0UL;
+				}
+				strs = tmp;
+				strsz = nu;
+			}
+			memcpy(strs + strz, sym, sz);
+			recs[j].symo = (uint32_t)strz;
+			strz += sz;
+		}
+	}
+
+	hdr.nrec = (uint32_t)(end - beg + 1U);
+	hdr.strz = (uint32_t)strz;
+	iov_add(&hdr, sizeof(hdr));
+	iov_add(recs, hdr.nrec * sizeof(*recs));
+	iov_add(strs, strz);
+	return sizeof(hdr) + hdr.nrec * sizeof(*recs) + strz;
+}
 #endif	/* WEB_ASP_QUOTREQ */
 
 
@@ -787,7 +1086,7 @@ __posrpt1(fixc_msg_t msg, uint16_t idx, struct timeval now)
 }
 
 static size_t
-websvc_reqforposs(char **restrict tgt, size_t UNUSED(tsz), struct websvc_s sd)
+websvc_reqforposs(struct webrsp_s *restrict tgt, struct websvc_s sd)
 {
 	struct timeval now[1];
 	size_t nsy = ute_nsyms(uctx);
@@ -811,54 +1110,102 @@ websvc_reqforposs(char **restrict tgt, size_t UNUSED(tsz), struct websvc_s sd)
 	r = fixc_render_fixml_rndr(msg);
 	free_fixc(msg);
 	/* get ready for the harvest */
-	*tgt = r.str;
-	return r.len;
+	return rndr_add(tgt, r);
 }
 
 # else  /* !HAVE_LIBFIXC_FIX_H */
 static size_t
-websvc_reqforposs(char **restrict tgt, size_t tsz, struct websvc_s sd)
+websvc_reqforposs(struct webrsp_s *restrict tgt, struct websvc_s sd)
 {
-	return websvc_unk(tgt, tsz, sd);
+	return websvc_unk(tgt, sd);
 }
 # endif	/* HAVE_LIBFIXC_FIX_H */
 #endif	/* WEB_ASP_REQFORPOSS */
 
 
 static void
-paste_clen(char *restrict buf, size_t len)
+paste_clen(char *restrict buf, size_t bsz, size_t len)
 {
-/* print ascii repr of LEN at BUF. */
-	buf[0] = ' ';
-	buf[1] = ' ';
-	buf[2] = ' ';
-	buf[3] = ' ';
-
-	buf[4] = (len % 10U) + '0';
-	if ((len /= 10U)) {
-		buf[3] = (len % 10U) + '0';
-		if ((len /= 10U)) {
-			buf[2] = (len % 10U) + '0';
-			if ((len /= 10U)) {
-				buf[1] = (len % 10U) + '0';
-				if ((len /= 10U)) {
-					buf[0] = (len % 10U) + '0';
-				}
-			}
-		}
-	}
+/* print ascii repr of LEN right-aligned in the BSZ bytes at BUF. */
+	memset(buf, ' ', bsz);
+	do {
+		buf[--bsz] = (len % 10U) + '0';
+	} while ((len /= 10U) && bsz);
 	return;
 }
 
 
 struct websvc_s
-websvc(const char *req, size_t UNUSED(len))
+websvc(const char *req, size_t len)
 {
 	static const char get_slash[] = "GET /";
+	/* request line, services may scribble on it */
+	static char rl[1024];
 	struct websvc_s res = {WEBSVC_F_UNK};
-	const char *p;
+	const char *eoh;
+	const char *bor = req;
+	size_t hdz;
+	size_t rlz;
+	char *p;
+
+	/* skip empty lines between pipelined requests */
+	for (; bor < req + len && (*bor == '\r' || *bor == '\n'); bor++);
+	len -= bor - req;
+
+	/* find the end of the header */
+	if ((eoh = memmem(bor, len, "\r\n\r\n", 4)) != NULL) {
+		hdz = eoh - bor + 4;
+	} else if ((eoh = memmem(bor, len, "\n\n", 2)) != NULL) {
+		hdz = eoh - bor + 2;
+	} else {
+		/* incomplete, inspect what we've got anyway */
+		hdz = 0UL;
+	}
+
+	/* isolate the request line */
+	if ((eoh = memchr(bor, '\n', len)) != NULL) {
+		rlz = eoh - bor;
+	} else {
+		rlz = len;
+	}
+	if (rlz >= sizeof(rl)) {
+		rlz = sizeof(rl) - 1;
+	}
+	memcpy(rl, bor, rlz);
+	rl[rlz] = '\0';
+
+	if (hdz) {
+		const char *hz = bor + hdz;
+		const char *v;
+		size_t clen = 0UL;
+
+#define HDR_MATCHES_P(v, x)				\
+		(strncasecmp(v, x, sizeof(x) - 1) == 0)
+		/* HTTP/1.0 needs an explicit keep-alive */
+		if ((v = __find_hdr(bor, hdz, "Connection:", 11)) != NULL) {
+			res.clo = HDR_MATCHES_P(v, "close");
+		} else {
+			res.clo = strstr(rl, "HTTP/1.0") != NULL;
+		}
+		/* websocket upgrades, anything after the path is ignored */
+		if ((v = __find_hdr(bor, hdz, "Upgrade:", 8)) != NULL &&
+		    HDR_MATCHES_P(v, "websocket") &&
+		    (p = strstr(rl, get_slash)) != NULL) {
+			res.ty = WEBSVC_F_WEBSOCK;
+			res.websock.idx = __find_idx(p);
+			res.len = hz - req;
+			return res;
+		}
+		/* skip over request bodies */
+		if ((v = __find_hdr(bor, hdz, "Content-Length:", 15)) != NULL) {
+			clen = strtoul(v, NULL, 10);
+		}
+		if (hz + clen <= bor + len) {
+			res.len = hz + clen - req;
+		}
+	}
 
-	if ((p = strstr(req, get_slash))) {
+	if ((p = strstr(rl, get_slash))) {
 		p += sizeof(get_slash) - 1;
 
 #define TAG_MATCHES_P(p, x)				\
@@ -878,6 +1225,14 @@ websvc(const char *req, size_t UNUSED(len))
 			res.quotreq.idx =
 				__find_idx(p + sizeof(QUOTREQ_TAG) - 1);
 
+#define QUOTBIN_TAG	"quotbin"
+		} else if (TAG_MATCHES_P(p, QUOTBIN_TAG)) {
+			WEB_DEBUG("quotbin query\n");
+			res.ty = WEBSVC_F_QUOTBIN;
+			res.quotbin.idx =
+				__find_idx(p + sizeof(QUOTBIN_TAG) - 1);
+			res.quotbin.syms = strstr(p, "syms") != NULL;
+
 #define REQFORPOSS_TAG	"reqforposs"
 		} else if (TAG_MATCHES_P(p, REQFORPOSS_TAG)) {
 			WEB_DEBUG("reqforposs query\n");
@@ -894,80 +1249,84 @@ websvc(const char *req, size_t UNUSED(len))
 struct webrsp_s
 web(struct websvc_s ws)
 {
-	/* the final \n will be subst'd later on */
-#define HDR		"\
+#define HDR(conn)	"\
 HTTP/1.1 200 OK\r\n\
 Server: um-quod\r\n\
+Connection: " conn "\r\n\
 Content-Length: "
-#define CLEN_SPEC	"% 5zu"
-#define BUF_INIT	HDR CLEN_SPEC "\r\n\r\n"
-	/* hdr is a format string and hdr_len is as wide as the result printed
-	 * later on */
-#if defined HAVE_LIBFIXC_FIX_H
-	static char __rsp[4096] = BUF_INIT;
-#else  /* !HAVE_LIBFIXC_FIX_H */
-	static char __rsp[65536] = BUF_INIT;
-#endif	/* HAVE_LIBFIXC_FIX_H */
-	char *rsp = __rsp + sizeof(BUF_INIT) - 1;
-	const size_t rsp_len = sizeof(__rsp) - (sizeof(BUF_INIT) - 1);
+#define CLEN_SPEC	"          "
+#define EOH		"\r\n\r\n"
+	/* CLEN_SPEC is a placeholder as wide as the content length we
+	 * paste in later on */
+	static char __rsp_ka[] = HDR("keep-alive") CLEN_SPEC EOH;
+	static char __rsp_clo[] = HDR("close") CLEN_SPEC EOH;
+	char *rsp = !ws.clo ? __rsp_ka : __rsp_clo;
+	size_t rsz = !ws.clo ? sizeof(__rsp_ka) - 1 : sizeof(__rsp_clo) - 1;
 	size_t cont_len;
-	struct webrsp_s res;
+	struct webrsp_s res = {NULL};
+
+	/* reset the scatter-gather list, keep a slot for the header */
+	iov_reset();
+	iov_add(rsp, rsz);
 
 	switch (ws.ty) {
 	default:
 	case WEBSVC_F_UNK:
-		cont_len = websvc_unk(&rsp, rsp_len, ws);
+		cont_len = websvc_unk(&res, ws);
 		break;
 
 	case WEBSVC_F_SECDEF:
 #if defined WEB_ASP_SECDEF
-		cont_len = websvc_secdef(&rsp, rsp_len, ws);
+		cont_len = websvc_secdef(&res, ws);
 #else  /* !WEB_ASP_SECDEF */
-		cont_len = websvc_unk(&rsp, rsp_len, ws);
+		cont_len = websvc_unk(&res, ws);
 #endif	/* WEB_ASP_SECDEF */
 		break;
 	case WEBSVC_F_QUOTREQ:
 #if defined WEB_ASP_QUOTREQ
-		cont_len = websvc_quotreq(&rsp, rsp_len, ws);
+		cont_len = websvc_quotreq(&res, ws);
 #else  /* !WEB_ASP_QUOTREQ */
-		cont_len = websvc_unk(&rsp, rsp_len, ws);
+		cont_len = websvc_unk(&res, ws);
+#endif	/* WEB_ASP_QUOTREQ */
+		break;
+	case WEBSVC_F_QUOTBIN:
+#if defined WEB_ASP_QUOTREQ
+		cont_len = websvc_quotbin(&res, ws);
+#else  /* !WEB_ASP_QUOTREQ */
+		cont_len = websvc_unk(&res, ws);
 #endif	/* WEB_ASP_QUOTREQ */
 		break;
 	case WEBSVC_F_REQFORPOSS:
 #if defined WEB_ASP_REQFORPOSS
-		cont_len = websvc_reqforposs(&rsp, rsp_len, ws);
+		cont_len = websvc_reqforposs(&res, ws);
 #else  /* !WEB_ASP_REQFORPOSS */
-		cont_len = websvc_unk(&rsp, rsp_len, ws);
+		cont_len = websvc_unk(&res, ws);
 #endif	/* WEB_ASP_REQFORPOSS */
 		break;
 	}
 
 	/* prepare the header */
-	paste_clen(__rsp + sizeof(HDR) - 1, cont_len);
+	paste_clen(
+		rsp + rsz - (sizeof(EOH) - 1) - (sizeof(CLEN_SPEC) - 1),
+		sizeof(CLEN_SPEC) - 1, cont_len);
 
-	res.hdr = __rsp;
-	res.hdz = sizeof(BUF_INIT) - 1;
-	/* in the libfixc case this will be an exploded struct fixc_rndr_s */
-	res.cnt = rsp;
-	res.cnz = cont_len;
+	if (UNLIKELY(iov_oom)) {
+		/* send_webrsp() will refuse this */
+		return res;
+	}
+	res.iov = iov;
+	res.niov = niov;
+	res.len = rsz + cont_len;
 	return res;
 }
 
-#if defined HAVE_LIBFIXC_FIX_H
-static inline void*
-unconst(union {const void *c; void *p;} __attribute__((transparent_union)) p)
-{
-	return p.p;
-}
-#endif	/* HAVE_LIBFIXC_FIX_H */
-
 void
 free_webrsp(struct webrsp_s rsp)
 {
 #if defined HAVE_LIBFIXC_FIX_H
-	if (rsp.hdr + rsp.hdz != rsp.cnt) {
+	if (rsp.cnt != NULL) {
 		/* must come from a fixc alloc'ing renderer */
-		fixc_free_rndr((struct fixc_rndr_s){unconst(rsp.cnt), rsp.cnz});
+		fixc_free_rndr((struct fixc_rndr_s){rsp.cnt, rsp.cnz});
 	}
 #else  /* HAVE_LIBFIXC_FIX_H */
 	(void)rsp;
@@ -975,4 +1334,36 @@ free_webrsp(struct webrsp_s rsp)
 	return;
 }
 
+ssize_t
+send_webrsp(int fd, struct webrsp_s *rsp)
+{
+	if (UNLIKELY(rsp->iov == NULL)) {
+		/* response couldn't be put together */
+		return -1;
+	}
+	while (rsp->niov > 0U) {
+		size_t n = rsp->niov < IOV_MAX ? rsp->niov : IOV_MAX;
+		ssize_t nwr = writev(fd, rsp->iov, n);
+
+		if (nwr < 0 && errno == EINTR) {
+			continue;
+		} else if (nwr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else if (nwr <= 0) {
+			return -1;
+		}
+		/* skip what's been written */
+		rsp->len -= nwr;
+		for (; rsp->niov > 0U && (size_t)nwr >= rsp->iov->iov_len;
+		     rsp->iov++, rsp->niov--) {
+			nwr -= rsp->iov->iov_len;
+		}
+		if (nwr > 0) {
+			rsp->iov->iov_base = (char*)rsp->iov->iov_base + nwr;
+			rsp->iov->iov_len -= nwr;
+		}
+	}
+	return rsp->len;
+}
+
 /* web.c ends here */
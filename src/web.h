@@ -37,16 +37,30 @@
 #if !defined INCLUDED_web_h_
 #define INCLUDED_web_h_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
 /* web services */
 typedef enum {
 	WEBSVC_F_UNK,
 	WEBSVC_F_SECDEF,
 	WEBSVC_F_QUOTREQ,
 	WEBSVC_F_REQFORPOSS,
+	WEBSVC_F_WEBSOCK,
+	WEBSVC_F_QUOTBIN,
 } websvc_f_t;
 
+/* instrument index denoting all instruments */
+#define WEBSVC_ALL	(0xffffU)
+
 struct websvc_s {
 	websvc_f_t ty;
+	/* number of bytes making up the request, 0 if incomplete */
+	size_t len;
+	/* whether the client wants the connection closed afterwards */
+	bool clo;
 
 	union {
 		struct {
@@ -57,23 +71,60 @@ struct websvc_s {
 			uint16_t idx;
 		} quotreq;
 
+		struct {
+			uint16_t idx;
+			/* append the symbol table */
+			bool syms;
+		} quotbin;
+
 		struct {
 			const char *ac;
 			size_t acz;
 		} reqforposs;
+
+		struct {
+			/* initial subscription */
+			uint16_t idx;
+		} websock;
 	};
 };
 
 struct webrsp_s {
-	const char *hdr;
-	size_t hdz;
-	const char *cnt;
+	/* header and content as scatter-gather list, header first */
+	struct iovec *iov;
+	size_t niov;
+	/* total length */
+	size_t len;
+
+	/* renderer-allocated content, if any */
+	char *cnt;
 	size_t cnz;
 };
 
 
+/**
+ * Parse the first request in BUF of size BSZ.
+ * Pipelined requests following it are left alone, the `len' slot
+ * tells where the next one begins. */
 extern struct websvc_s websvc(const char *buf, size_t bsz);
-extern struct webrsp_s web(struct websvc_s);
+/**
+ * Answer the web request WS.
+ * The response stays valid until the next call to `web()'. */
+extern struct webrsp_s web(struct websvc_s ws);
 extern void free_webrsp(struct webrsp_s);
 
+/**
+ * Render the quotes of all instruments whose index bit is set in SET
+ * (of NSET words) as websocket text frame.
+ * The response stays valid until the next call to `web()'. */
+extern struct webrsp_s web_push_quot(const uint64_t *set, size_t nset);
+
+/**
+ * Send the response RSP over socket FD.
+ * On non-blocking sockets this may stop short, RSP is then updated to
+ * describe the unsent rest.  Return the number of bytes left or -1 on
+ * error, responses that ran out of memory while being put together
+ * count as errors. */
+extern ssize_t send_webrsp(int fd, struct webrsp_s *rsp);
+
 #endif	/* INCLUDED_web_h_ */
@@ -312,20 +312,42 @@ prune_clis(void)
 
 
 /* pair handling */
-static size_t npaths;
-
 struct bbo_s {
 	m30_t b;
 	m30_t a;
+	m30_t bq;
+	m30_t aq;
 };
 
-static gpair_t
-find_pair_by_sym(graph_t g, const char *sym)
-{
+/* the crosses we publish */
+struct xpub_s {
 	struct pair_s p;
+	gcross_t x;
 
-	if ((p.bas = find_iso_4217_by_name(sym)) == NULL) {
-		return NULL_PAIR;
+	/* brag index and symbol */
+	uint16_t idx;
+	size_t symlen;
+	char sym[16U];
+
+	/* what's been sent last and when */
+	struct bbo_s last;
+	time_t last_brag;
+	ev_tstamp last_pub;
+
+	/* coalescing timer, active while an update is held back */
+	ev_timer tm[1];
+};
+
+static struct xpub_s *xpub;
+static size_t nxpub;
+/* minimum time between two updates of the same cross */
+static ev_tstamp min_intv;
+
+static int
+parse_pair(struct pair_s *tgt, const char *sym)
+{
+	if ((tgt->bas = find_iso_4217_by_name(sym)) == NULL) {
+		return -1;
 	}
 	/* otherwise at least the base currency is there */
 	switch (sym[3]) {
@@ -337,16 +359,27 @@ find_pair_by_sym(graph_t g, const char *sym)
 		break;
 	case '\0':
 		/* fuck!!! */
-		return NULL_PAIR;
+		return -1;
 	}
 	/* YAY, we survived the hardest part, the unstandardised separator */
-	if ((p.trm = find_iso_4217_by_name(sym)) == NULL) {
+	if ((tgt->trm = find_iso_4217_by_name(sym)) == NULL) {
+		return -1;
+	}
+	return 0;
+}
+
+static gpair_t
+find_pair_by_sym(graph_t g, const char *sym)
+{
+	struct pair_s p;
+
+	if (parse_pair(&p, sym) < 0) {
 		return NULL_PAIR;
 	}
 	return ccyg_find_pair(g, p);
 }
 
-static uint64_t
+static size_t
 upd_pair(graph_t g, gpair_t p, const_sl1t_t cell)
 {
 	double pri, qty;
@@ -377,100 +410,86 @@ upd_pair(graph_t g, gpair_t p, const_sl1t_t cell)
 }
 
 static struct bbo_s
-find_bbo(graph_t g)
+find_bbo(graph_t g, gcross_t x)
 {
-	struct bbo_s res = {0, 0};
-
-	for (size_t i = 9; i < 9 + npaths; i++) {
-		m30_t bid = ffff_m30_get_d(get_bid(g, i));
-		m30_t ask = ffff_m30_get_d(get_ask(g, i));
-
-		bid.mant -= bid.mant % 1000;
-		ask.mant -= ask.mant % 1000;
-
-		if (res.b.u == 0 || bid.u && res.b.v < bid.v) {
-			res.b = bid;
-		}
-		if (res.a.u == 0 || ask.u && res.a.v > ask.v) {
-			res.a = ask;
-		}
-	}
+/* the cross keeps its paths in order, best bid and ask are on top
+ * along with what they're good for */
+	struct ccyg_tob_s tob = ccyg_cross_tob(g, x);
+	struct bbo_s res;
+
+	res.b = ffff_m30_get_d(tob.bid);
+	res.a = ffff_m30_get_d(tob.ask);
+	res.bq = ffff_m30_get_d(tob.bsz);
+	res.aq = ffff_m30_get_d(tob.asz);
+
+	res.b.mant -= res.b.mant % 1000;
+	res.a.mant -= res.a.mant % 1000;
 	return res;
 }
 
 
+static bool
+bbo_eq_p(struct bbo_s x, struct bbo_s y)
+{
+	return x.b.u == y.b.u && x.bq.u == y.bq.u &&
+		x.a.u == y.a.u && x.aq.u == y.aq.u;
+}
+
+
 static ud_sock_t ute_out_ch;
 
-static void
-dissem_bbo(struct bbo_s bbo)
+static size_t
+dissem_bbo(struct xpub_s *xp, struct bbo_s bbo, const struct timeval *now)
 {
-	static struct bbo_s last_bbo;
-	static time_t last_brag;
+/* pack BBO for cross XP, return the number of messages packed,
+ * flushing is left to the caller so crosses can go out together */
+	struct bbo_s last_bbo = xp->last;
 	struct sl1t_s new[1];
-	struct timeval now[1];
+	size_t res = 0U;
 
-	if (bbo.b.u == last_bbo.b.u && bbo.a.u == last_bbo.a.u) {
+	if (bbo_eq_p(bbo, last_bbo)) {
 		/* piss off right away, nothing's changed */
-		return;
+		return 0U;
 	}
 
-	gettimeofday(now, NULL);
-	if (now->tv_sec >= last_brag + 10) {
+	if (now->tv_sec >= xp->last_brag + 10) {
 		struct um_qmeta_s brg = {
-			.idx = 1U,
-			.sym = "EURAUDx",
-			.symlen = 7U,
+			.idx = xp->idx,
+			.sym = xp->sym,
+			.symlen = xp->symlen,
 			.uri = NULL,
 			.urilen = 0U,
 		};
 
 		(void)um_pack_brag(ute_out_ch, &brg);
-		last_brag = now->tv_sec;
+		xp->last_brag = now->tv_sec;
+		res++;
 	}
 
 	/* bit of prep work */
 	sl1t_set_stmp_sec(new, now->tv_sec);
 	sl1t_set_stmp_msec(new, now->tv_usec / 1000);
-	sl1t_set_tblidx(new, 1);
+	sl1t_set_tblidx(new, xp->idx);
 
-	if (bbo.b.u == last_bbo.b.u) {
+	if (bbo.b.u != last_bbo.b.u || bbo.bq.u != last_bbo.bq.u) {
 		sl1t_set_ttf(new, SL1T_TTF_BID);
 
 		new->pri = bbo.b.u;
-#if defined HAVE_ANON_STRUCTS_INIT
-		new->qty = ((union m30_u){.expo = 1, .mant = 10000}).u;
-#else  /* !HAVE_ANON_STRUCTS_INIT */
-		{
-			m30_t tmp;
-			tmp.expo = 1;
-			tmp.mant = 10000;
-			new->qty = tmp.u;
-		}
-#endif	/* HAVE_ANON_STRUCTS_INIT */
+		new->qty = bbo.bq.u;
 		(void)um_pack_sl1t(ute_out_ch, new);
+		res++;
 	}
-	if (bbo.a.u != last_bbo.a.u) {
+	if (bbo.a.u != last_bbo.a.u || bbo.aq.u != last_bbo.aq.u) {
 		sl1t_set_ttf(new, SL1T_TTF_ASK);
 
 		new->pri = bbo.a.u;
-#if defined HAVE_ANON_STRUCTS_INIT
-		new->qty = ((union m30_u){.expo = 1, .mant = 10000}).u;
-#else  /* !HAVE_ANON_STRUCTS_INIT */
-		{
-			m30_t tmp;
-			tmp.expo = 1;
-			tmp.mant = 10000;
-			new->qty = tmp.u;
-		}
-#endif	/* HAVE_ANON_STRUCTS_INIT */
+		new->qty = bbo.aq.u;
 		(void)um_pack_sl1t(ute_out_ch, new);
+		res++;
 	}
 	/* just to have something we can compare things to */
-	last_bbo = bbo;
-
-	/* and really really send him off now */
-	ud_flush(ute_out_ch);
-	return;
+	xp->last = bbo;
+	return res;
 }
 
 static void
@@ -521,7 +540,7 @@ snarf_meta(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux, graph_t g)
 	return;
 }
 
-static uint64_t
+static size_t
 snarf_data(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux, graph_t g)
 {
 	struct sndwch_s s[4];
@@ -529,7 +548,7 @@ snarf_data(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux, graph_t g)
 	scom_t sp;
 	size_t sz;
 	struct key_s k;
-	uint64_t aff;
+	size_t aff;
 	cli_t c;
 
 	if ((sp = msg->data, (sz = scom_tick_size(sp)) != msg->dlen)) {
@@ -568,12 +587,58 @@ snarf_data(const struct ud_msg_s *msg, const struct ud_auxmsg_s *aux, graph_t g)
 /* the actual worker function */
 static graph_t gg;
 
+static void
+coal_cb(EV_P_ ev_timer *w, int UNUSED(revents))
+{
+/* the interval of a held back cross is up, send what it is now */
+	struct xpub_s *xp = w->data;
+	struct timeval now[1];
+
+	gettimeofday(now, NULL);
+	if (dissem_bbo(xp, find_bbo(gg, xp->x), now)) {
+		xp->last_pub = ev_now(EV_A);
+		ud_flush(ute_out_ch);
+	}
+	return;
+}
+
+static size_t
+pub_crosses(EV_P)
+{
+/* pack every cross whose top of book changed, crosses that were sent
+ * less than MIN_INTV ago are held back and left to their timers */
+	ev_tstamp t = ev_now(EV_A);
+	struct timeval now[1];
+	size_t res = 0U;
+
+	gettimeofday(now, NULL);
+	for (size_t i = 0U; i < nxpub; i++) {
+		struct xpub_s *xp = xpub + i;
+		struct bbo_s bbo;
+
+		if (ev_is_active(xp->tm)) {
+			/* held back already */
+			continue;
+		} else if (bbo_eq_p(bbo = find_bbo(gg, xp->x), xp->last)) {
+			continue;
+		} else if (t < xp->last_pub + min_intv) {
+			ev_timer_set(xp->tm, xp->last_pub + min_intv - t, 0.0);
+			ev_timer_start(EV_A_ xp->tm);
+			continue;
+		} else if (dissem_bbo(xp, bbo, now)) {
+			xp->last_pub = t;
+			res++;
+		}
+	}
+	return res;
+}
+
 static void
 mon_beef_cb(EV_P_ ev_io *w, int UNUSED(revents))
 {
 	struct ud_msg_s msg[1];
 	ud_sock_t s = w->data;
-	uint64_t aff = 0;
+	size_t aff = 0U;
 
 	while (ud_chck_msg(msg, s) >= 0) {
 		struct ud_auxmsg_s aux[1];
@@ -585,17 +650,16 @@ mon_beef_cb(EV_P_ ev_io *w, int UNUSED(revents))
 			break;
 
 		case UTE_CMD:
-			aff |= snarf_data(msg, aux, gg);
+			aff += snarf_data(msg, aux, gg);
 			break;
 		default:
 			break;
 		}
 	}
 
-	if (aff && ute_out_ch != NULL) {
-		struct bbo_s bbo = find_bbo(gg);
-
-		dissem_bbo(bbo);
+	if (aff && ute_out_ch != NULL && pub_crosses(EV_A)) {
+		/* all crosses of this tick go out in one go */
+		ud_flush(ute_out_ch);
 	}
 	return;
 }
@@ -632,10 +696,13 @@ prune_cb(EV_P_ ev_timer *w, int UNUSED(r))
 /* graph guts */
 #include "ccy-graph.c"
 
-/* this must be configurable somehow */
-static void
+/* this must be configurable somehow,
+ * only crosses reachable from these pairs can be published */
+static int
 build_hops(graph_t g)
 {
+	int rc = 0;
+
 	ccyg_add_pair(g, (struct pair_s){ISO_4217_EUR, ISO_4217_AUD});
 	ccyg_add_pair(g, (struct pair_s){ISO_4217_EUR, ISO_4217_USD});
 	ccyg_add_pair(g, (struct pair_s){ISO_4217_AUD, ISO_4217_USD});
@@ -648,14 +715,68 @@ build_hops(graph_t g)
 	/* population */
 	ccyg_populate(g);
 
-	/* and construct all paths */
-	npaths = ccyg_add_paths(g, (struct pair_s){ISO_4217_EUR, ISO_4217_AUD});
-	XQ_DEBUG("%zu virtual paths added\n", npaths);
+	/* and construct all paths of the crosses we publish */
+	for (size_t i = 0U; i < nxpub; i++) {
+		size_t UNUSED(np) = ccyg_add_paths(g, xpub[i].p);
+
+		XQ_DEBUG("%zu virtual paths added for %s\n", np, xpub[i].sym);
+		if ((xpub[i].x = ccyg_find_cross(g, xpub[i].p)) == NULL_CROSS) {
+			fprintf(logerr, "\
+cannot publish %s, no paths from the built-in pairs\n", xpub[i].sym);
+			rc = -1;
+		}
+	}
 
 #if defined DEBUG_FLAG
 	XQ_DEBUG("\nGRAPH NOW\n");
 	prnt_graph(g);
 #endif	/* DEBUG_FLAG */
+	return rc;
+}
+
+static int
+init_xpub(char *const *args, size_t nargs)
+{
+	static char *const dflt[] = {"EURAUD"};
+
+	if (nargs == 0U) {
+		args = dflt;
+		nargs = countof(dflt);
+	}
+	if ((xpub = calloc(nargs, sizeof(*xpub))) == NULL) {
+		return -1;
+	}
+	for (size_t i = 0U; i < nargs; i++) {
+		struct xpub_s *xp = xpub + nxpub;
+
+		if (parse_pair(&xp->p, args[i]) < 0 || xp->p.bas == xp->p.trm) {
+			fprintf(logerr, "cannot publish pair `%s'\n", args[i]);
+			free(xpub);
+			xpub = NULL;
+			nxpub = 0U;
+			return -1;
+		}
+		/* brag indices start at 1 */
+		xp->idx = (uint16_t)(nxpub + 1U);
+		xp->symlen = snprintf(
+			xp->sym, sizeof(xp->sym), "%s%sx",
+			xp->p.bas->sym, xp->p.trm->sym);
+		ev_timer_init(xp->tm, coal_cb, 0.0, 0.0);
+		xp->tm->data = xp;
+		nxpub++;
+	}
+	return 0;
+}
+
+static void
+fini_xpub(EV_P)
+{
+	for (size_t i = 0U; i < nxpub; i++) {
+		ev_timer_stop(EV_A_ xpub[i].tm);
+	}
+	free(xpub);
+	xpub = NULL;
+	nxpub = 0U;
 	return;
 }
 
@@ -724,6 +845,28 @@ main(int argc, char *argv[])
 		exit(1);
 	}
 
+	/* the crosses we publish and how often */
+	if (init_xpub(argi->args, argi->nargs) < 0) {
+		rc = 1;
+		goto out;
+	} else if (argi->rate_arg) {
+		double rate = strtod(argi->rate_arg, NULL);
+
+		min_intv = rate > 0. ? 1. / rate : 0.;
+	}
+
+	/* generate the graph we're talking */
+	if ((gg = make_graph()) == NULL) {
+		free(xpub);
+		rc = 1;
+		goto out;
+	} else if (build_hops(gg) < 0) {
+		free_graph(gg);
+		free(xpub);
+		rc = 1;
+		goto out;
+	}
+
 	/* initialise the main loop */
 	loop = ev_default_loop(EVFLAG_AUTO);
 
@@ -748,10 +891,6 @@ main(int argc, char *argv[])
 	nbeef = argi->beef_nargs + 1;
 	beef = malloc(nbeef * sizeof(*beef));
 
-	/* generate the graph we're talking */
-	gg = make_graph();
-	build_hops(gg);
-
 	/* attach a multicast listener, default channel for control msgs */
 	{
 		struct ud_sockopt_s opt = {UD_SUB};
@@ -817,9 +956,13 @@ past_loop:
 	/* finish cli space */
 	fini_cli();
 
+	/* stop coalescing and forget about the crosses */
+	fini_xpub(EV_A);
+
 	/* destroy the default evloop */
 	ev_default_destroy();
 
+out:
 	/* kick the config context */
 	yuck_free(argi);
 